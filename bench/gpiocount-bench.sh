@@ -0,0 +1,250 @@
+#!/bin/bash
+#
+# Comparative counting benchmark -- drives one gpio-sim line at increasing
+# rates and, for each counter, reports the edges lost, the CPU used and
+# the latency, as one JSON object per line on stdout:
+#
+#   gpiocount (button)  -- the increment button, with the LED path on
+#                          four more gpio-sim lines
+#   gpiocount (input)   -- an extra counter input, no LED path
+#   gpiocount (events)  -- an extra input with the edge event ring on
+#   interrupt-cnt       -- the kernel's counter driver, if a device of
+#                          that driver counts the same line (it needs a
+#                          device tree overlay, so the suite does not
+#                          create one), else skipped with the reason
+#   evcount             -- tools/gpiocount-evcount, counting in userspace
+#                          through the GPIO character device, as libgpiod
+#
+# and then, once, the button's edge-to-LED latency from outside the module
+# (tools/gpiocount-loopback, mode "loopback"): the button line is pulled
+# and the lowest LED line read back through gpio-sim until it follows,
+# next to the module's own latency_hist mean when that is built in
+#
+#   sudo bench/gpiocount-bench.sh [-s seconds] [-r "rate rate ..."] > report.jsonl
+#
+# Needs root, a kernel with gpio-sim, configfs and the GPIO sysfs class,
+# the module built (with GPIOCOUNT_EVENTS=1 GPIOCOUNT_LATENCY=1 for the
+# events run and the button latency), and 'make tools'. Latency is the
+# edge-to-LED histogram mean for the button, the read delay for evcount,
+# and null where the counter offers no measure of it. CPU is the irq and
+# softirq time of all CPUs plus that of the IRQ threads (and of evcount
+# itself), as a share of all CPUs' time -- the pulse generator's own
+# interrupt work is in it too, the same for every counter.
+
+set -e
+
+HERE=$(cd "$(dirname "$0")/.." && pwd)
+SECONDS_PER_RUN=5
+RATES="100 1000 5000 10000 20000 50000"
+LEDS=4 # sim lines 1..LEDS, driven by the button's LED path
+
+while getopts "s:r:" opt; do
+	case $opt in
+	s) SECONDS_PER_RUN=$OPTARG ;;
+	r) RATES=$OPTARG ;;
+	*) echo "usage: $0 [-s seconds] [-r \"rate ...\"]" >&2; exit 2 ;;
+	esac
+done
+
+SYSFS=/sys/kernel/gpiocount
+SIM=/sys/kernel/config/gpio-sim/gpiocount-bench
+VERSION=$(git -C "$HERE" describe --always --dirty 2>/dev/null || echo unknown)
+
+cleanup() {
+	rmmod gpiocount 2>/dev/null || true
+	if [ -d "$SIM" ]; then
+		echo 0 > "$SIM/live" 2>/dev/null || true
+		rmdir "$SIM/bank0/line0" "$SIM/bank0" "$SIM" 2>/dev/null || true
+	fi
+}
+trap cleanup EXIT
+
+# line 0 is the input, pulled by writing its 'pull' attribute, and the
+# lines after it are outputs for the LEDs
+modprobe gpio-sim
+mkdir -p "$SIM/bank0/line0"
+echo $((1 + LEDS)) > "$SIM/bank0/num_lines"
+echo 1 > "$SIM/live"
+DEV=$(cat "$SIM/dev_name")
+CHIP=$(cat "$SIM/bank0/chip_name")
+PULL=/sys/devices/platform/$DEV/$CHIP/sim_gpio0/pull
+# legacy GPIO number, for gpiocount
+GPIO=
+for chip in /sys/class/gpio/gpiochip*; do
+	if [ "$(cat "$chip/label")" = "$DEV-node0" ]; then
+		GPIO=$(cat "$chip/base")
+	fi
+done
+if [ -z "$GPIO" ]; then
+	echo "no legacy GPIO number for $DEV -- is CONFIG_GPIO_SYSFS set?" >&2
+	exit 1
+fi
+
+LED_GPIOS=$(seq -s, $((GPIO + 1)) $((GPIO + LEDS)))
+CLK_TCK=$(getconf CLK_TCK)
+
+# clock ticks spent by the IRQ threads (irq/<n>-<name>), so far
+irq_thread_ticks() {
+	cat /proc/[0-9]*/stat 2>/dev/null | 
+		awk '$2 ~ /^\(irq\// { t += $14 + $15 } END { print t + 0 }'
+}
+
+# interrupt and total ticks over all CPUs -- irq and softirq from
+# /proc/stat, which hold the hard handlers, plus the IRQ threads, which
+# hold threaded handlers (gpio-sim lines can sleep, so theirs are)
+cpu_sample() {
+	local threads=$(irq_thread_ticks)
+	awk -v threads=$threads '/^cpu /{ 
+		print $7 + $8 + threads, $2+$3+$4+$5+$6+$7+$8 }' /proc/stat
+}
+
+cpu_percent() { # before after
+	echo "$1 $2" | awk '{ t = $4 - $2; printf "%.2f", t ? 100 * ($3 - $1) / t : 0 }'
+}
+
+report() { # counter mode rate sent counted cpu latency
+	local lost=$(($4 - $5))
+	[ $lost -lt 0 ] && lost=0
+	printf '{"version":"%s","counter":"%s","mode":"%s","rate_hz":%s,' \
+		"$VERSION" "$1" "$2" "$3"
+	printf '"sent":%s,"counted":%s,"lost":%s,"cpu_pct":%s,"latency_ns":%s}\n' \
+		"$4" "$5" "$lost" "$6" "$7"
+}
+
+pulse() { # rate -- prints the pulses sent
+	"$HERE/tools/gpiocount-pulse" -r "$1" -s "$SECONDS_PER_RUN" "$PULL" | \
+		cut -d' ' -f1
+}
+
+run_gpiocount() { # mode rate
+	local params="enable_gpio=1"
+	[ "$1" = events ] && params="$params event_ring_kb=1024"
+	insmod "$HERE/gpiocount.ko" $params
+	echo 0 > $SYSFS/debounce_msec
+	if [ "$1" = button ]; then
+		if [ -e /sys/module/gpiocount/parameters/measure_latency ]; then
+			echo 1 > /sys/module/gpiocount/parameters/measure_latency
+		fi
+		# without LEDs a press returns before the LED path
+		echo $LED_GPIOS > $SYSFS/gpio_leds
+		echo $GPIO > $SYSFS/gpio_button_increment
+	else
+		echo $GPIO > $SYSFS/gpio_inputs
+	fi
+	local before=$(cpu_sample)
+	local sent=$(pulse "$2")
+	local after=$(cpu_sample)
+	local counts=$(cat $SYSFS/input_counts)
+	local counted=${counts%%,*}
+	[ "$1" != button ] && counted=${counts#*,}
+	local latency=null
+	if [ "$1" = button ] && [ -e $SYSFS/latency_hist ]; then
+		latency=$(sed -n 's/.*mean_ns \([0-9]*\).*/\1/p' $SYSFS/latency_hist)
+	fi
+	rmmod gpiocount
+	report gpiocount "$1" "$2" "$sent" "$counted" \
+		"$(cpu_percent "$before" "$after")" "$latency"
+}
+
+# the sim line's consumer in debugfs, e.g. "platform-counter.0"
+gpio_consumer() {
+	sed -n "s/^ *gpio-$GPIO ([^|]*|\([^)]*\)).*/\1/p" /sys/kernel/debug/gpio |
+		sed 's/ *$//'
+}
+
+# Sets COUNTER_DEV to an interrupt-cnt counter on the sim line, or
+# COUNTER_SKIP to why there is none. The driver is matched, not the
+# counter's name, which is the device's own; the line is checked through
+# its consumer, as interrupt-cnt takes its GPIO under its device's name
+find_interrupt_cnt() {
+	COUNTER_DEV=
+	COUNTER_SKIP="no counter device is bound to the interrupt-cnt driver"
+	local dev driver parent
+	for dev in /sys/bus/counter/devices/counter*; do
+		driver=$(readlink "$dev/device/driver" 2>/dev/null) || continue
+		[ "${driver##*/}" = interrupt-cnt ] || continue
+		parent=$(basename "$(readlink -f "$dev/device")")
+		if [ ! -r /sys/kernel/debug/gpio ]; then
+			COUNTER_SKIP="$parent found, but its GPIO cannot be checked without debugfs"
+		elif [ "$(gpio_consumer)" != "$parent" ]; then
+			COUNTER_SKIP="$parent found, but it does not count GPIO $GPIO"
+		else
+			COUNTER_DEV=$dev
+			return
+		fi
+	done
+}
+
+run_interrupt_cnt() { # device rate
+	echo 0 > "$1/count0/count"
+	echo 1 > "$1/count0/enable"
+	local before=$(cpu_sample)
+	local sent=$(pulse "$2")
+	local after=$(cpu_sample)
+	local counted=$(cat "$1/count0/count")
+	report interrupt-cnt edge "$2" "$sent" "$counted" \
+		"$(cpu_percent "$before" "$after")" null
+}
+
+run_evcount() { # rate
+	local out=$(mktemp)
+	"$HERE/tools/gpiocount-evcount" -s $((SECONDS_PER_RUN + 1)) \
+		/dev/$CHIP 0 > "$out" &
+	local counter=$!
+	sleep 0.5 # let it request the line
+	local before=$(cpu_sample)
+	local sent=$(pulse "$1")
+	local after=$(cpu_sample)
+	wait $counter
+	read counted cpu_ns latency latency_max < "$out"
+	rm -f "$out"
+	# the counting is done in evcount's own process time
+	local own=$((cpu_ns * CLK_TCK / 1000000000))
+	after="$(( ${after%% *} + own )) ${after#* }"
+	report evcount uapi "$1" "$sent" "$counted" \
+		"$(cpu_percent "$before" "$after")" "$latency"
+}
+
+run_loopback() {
+	insmod "$HERE/gpiocount.ko" enable_gpio=1
+	if [ -e /sys/module/gpiocount/parameters/measure_latency ]; then
+		echo 1 > /sys/module/gpiocount/parameters/measure_latency
+	fi
+	echo 0 > $SYSFS/debounce_msec
+	echo $LED_GPIOS > $SYSFS/gpio_leds
+	echo $GPIO > $SYSFS/gpio_button_increment
+	local led=/sys/devices/platform/$DEV/$CHIP/sim_gpio1/value
+	read presses mean p50 p99 max < <("$HERE/tools/gpiocount-loopback" \
+		-n 1000 -i 5 "$PULL" "$led")
+	local module=null
+	if [ -e $SYSFS/latency_hist ]; then
+		module=$(sed -n 's/.*mean_ns \([0-9]*\).*/\1/p' $SYSFS/latency_hist)
+	fi
+	rmmod gpiocount
+	printf '{"version":"%s","counter":"gpiocount","mode":"loopback",' "$VERSION"
+	printf '"presses":%s,"latency_ns":%s,"latency_p50_ns":%s,' \
+		"$presses" "$mean" "$p50"
+	printf '"latency_p99_ns":%s,"latency_max_ns":%s,"module_latency_ns":%s}\n' \
+		"$p99" "$max" "$module"
+}
+
+find_interrupt_cnt
+MODES="button input"
+if modinfo -p "$HERE/gpiocount.ko" | grep -q '^event_ring_kb:'; then
+	MODES="$MODES events"
+else
+	echo "gpiocount (events): built without GPIOCOUNT_EVENTS -- skipped" >&2
+fi
+for rate in $RATES; do
+	for mode in $MODES; do
+		run_gpiocount $mode $rate
+	done
+	if [ -n "$COUNTER_DEV" ]; then
+		run_interrupt_cnt "$COUNTER_DEV" $rate
+	fi
+	run_evcount $rate
+done
+if [ -z "$COUNTER_DEV" ]; then
+	echo "interrupt-cnt: $COUNTER_SKIP -- skipped" >&2
+fi
+run_loopback
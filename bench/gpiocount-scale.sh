@@ -0,0 +1,129 @@
+#!/bin/bash
+#
+# Scaling benchmark -- loads the module with simulated GPIO and many extra
+# inputs, and reports what the inputs cost as their number grows, as one
+# JSON object per line on stdout:
+#
+#   rates  -- 1 to 1000 inputs, a few of them pulsing through sim_edge and
+#             the rest idle: the housekeeping timer runs (rates need none,
+#             so idle inputs cost nothing between reads), the mean cost of
+#             the count phase per edge, which holds the O(1) rate update,
+#             and the time to read input_rates, where the rates are worked
+#             out for every input
+#   stalls -- 100 to 10000 inputs, each pulsed once and then left to stall
+#             with stall_sec 1: the duration of one bulk stall scan from
+#             stall_scan, the stall events it raised, and the time to read
+#             stalled_inputs
+#
+#   sudo bench/gpiocount-scale.sh [-s seconds] > scale.jsonl
+#
+# Needs root and the module built; for the count phase cost also with
+# GPIOCOUNT_PROFILE=1 and debugfs, otherwise it is null. No GPIO hardware
+# or gpio-sim is used: input numbers are only labels without enable_gpio.
+
+set -e
+
+HERE=$(cd "$(dirname "$0")/.." && pwd)
+SECONDS_PER_RUN=5
+ACTIVE=10 # inputs that pulse
+READS=100
+
+while getopts "s:" opt; do
+	case $opt in
+	s) SECONDS_PER_RUN=$OPTARG ;;
+	*) echo "usage: $0 [-s seconds]" >&2; exit 2 ;;
+	esac
+done
+
+SYSFS=/sys/kernel/gpiocount
+PARAMS=/sys/module/gpiocount/parameters
+PROFILE=/sys/kernel/debug/gpiocount/profile
+VERSION=$(git -C "$HERE" describe --always --dirty 2>/dev/null || echo unknown)
+
+trap 'rmmod gpiocount 2>/dev/null || true' EXIT
+
+load() { # inputs
+	insmod "$HERE/gpiocount.ko" sim_gpio=1 sim_trace_len=0 \
+		max_inputs=$(($1 + 1))
+	if [ -e $PARAMS/profile_phases ]; then
+		echo 1 > $PARAMS/profile_phases
+	fi
+	echo 0 > $SYSFS/debounce_msec
+	echo "1-$1" > $SYSFS/gpio_inputs
+}
+
+now_us() {
+	echo $(($(date +%s%N) / 1000))
+}
+
+# one pulse on each of the first n extra inputs (inputs 1..n)
+pulse_inputs() { # n
+	local i
+	for ((i = 1; i <= $1; i++)); do
+		echo "$i 1" > $SYSFS/sim_edge
+		echo "$i 0" > $SYSFS/sim_edge
+	done
+}
+
+# mean cost of a phase, in the profile's unit, or null without it
+profile_mean() { # phase
+	if [ -r $PROFILE ]; then
+		awk -v phase=$1 '$1 == phase { print $4 }' $PROFILE
+	else
+		echo null
+	fi
+}
+
+run_rates() { # inputs
+	load "$1"
+	local active=$((ACTIVE < $1 ? ACTIVE : $1))
+	local runs=$(cat $SYSFS/housekeeping_runs)
+	local end=$(($(date +%s) + SECONDS_PER_RUN))
+	local edges=0
+	while [ "$(date +%s)" -lt $end ]; do
+		pulse_inputs $active
+		edges=$((edges + 2 * active))
+		sleep 0.01
+	done
+	runs=$(($(cat $SYSFS/housekeeping_runs) - runs))
+	local count=$(profile_mean count)
+	local start=$(now_us)
+	local i
+	for ((i = 0; i < READS; i++)); do
+		cat $SYSFS/input_rates > /dev/null
+	done
+	local read_us=$((($(now_us) - start) / READS))
+	rmmod gpiocount
+	printf '{"version":"%s","bench":"rates","inputs":%s,"active":%s,' \
+		"$VERSION" "$1" "$active"
+	printf '"seconds":%s,"edges":%s,"timer_runs":%s,"count_cost":%s,' \
+		"$SECONDS_PER_RUN" "$edges" "$runs" "$count"
+	printf '"read_us":%s}\n' "$read_us"
+}
+
+run_stalls() { # inputs
+	load "$1"
+	pulse_inputs "$1"
+	echo 1 > $SYSFS/stall_sec
+	# housekeeping is deferrable and rounded to whole seconds
+	sleep 3
+	local scan_ns=$(sed -n 's/.* ns \([0-9]*\)/\1/p' $SYSFS/stall_scan)
+	local events=$(cat $SYSFS/stall_events)
+	local start=$(now_us)
+	local i
+	for ((i = 0; i < READS; i++)); do
+		cat $SYSFS/stalled_inputs > /dev/null
+	done
+	local read_us=$((($(now_us) - start) / READS))
+	rmmod gpiocount
+	printf '{"version":"%s","bench":"stalls","inputs":%s,"scan_ns":%s,' \
+		"$VERSION" "$1" "$scan_ns"
+	printf '"stall_events":%s,"read_us":%s}\n' "$events" "$read_us"
+}
+
+for inputs in 1 10 100 1000; do
+	run_rates $inputs
+done
+for inputs in 100 1000 10000; do
+	run_stalls $inputs
+done
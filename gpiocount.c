@@ -1,7 +1,58 @@
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/gpio.h>
+#include <linux/gpio/consumer.h>
 #include <linux/interrupt.h>
+#include <linux/bitmap.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+#include <linux/timer.h>
+#include <linux/spinlock.h>
+#include <linux/seqlock.h>
+#include <linux/capability.h>
+#include <linux/vmalloc.h>
+#include <linux/alarmtimer.h>
+#include <linux/mutex.h>
+#include <linux/cache.h>
+#include <linux/debugfs.h>
+#include <linux/percpu.h>
+#include <linux/seq_file.h>
+#include <linux/timex.h>
+
+#include "gpiocount_debounce.h"
+#include "gpiocount_event.h"
+#include "gpiocount_gesture.h"
+#include "gpiocount_state.h"
+
+/**
+ * Optional features -- set from the Makefile, e.g. make GPIOCOUNT_EVENTS=1,
+ * and all off by default, so the default build has the smallest interrupt
+ * path. On the interrupt path they are tested as constants and fold away;
+ * their sysfs entries, handlers and setup are left out with #if. See also
+ * GC_DEBOUNCE_GLITCH and GC_DEBOUNCE_ADAPT in gpiocount_debounce.h
+ */
+
+#ifndef GPIOCOUNT_EVENTS
+#define GPIOCOUNT_EVENTS 0 // edge event ring
+#endif
+#ifndef GPIOCOUNT_LATENCY
+#define GPIOCOUNT_LATENCY 0 // edge-to-LED latency histogram
+#endif
+#ifndef GPIOCOUNT_GESTURES
+#define GPIOCOUNT_GESTURES 0 // long and double press detection
+#endif
+#ifndef GPIOCOUNT_TARIFFS
+#define GPIOCOUNT_TARIFFS 0 // time-of-use tariff registers
+#endif
+#ifndef GPIOCOUNT_BARS
+#define GPIOCOUNT_BARS 0 // rate bar display encodings
+#endif
+#ifndef GPIOCOUNT_PROFILE
+#define GPIOCOUNT_PROFILE 0 // per-phase cycle accounting in debugfs
+#endif
+#ifndef GPIOCOUNT_VERBOSE
+#define GPIOCOUNT_VERBOSE 0 // log every press and LED write
+#endif
 
 MODULE_LICENSE("GPL");
 MODULE_DESCRIPTION("Counter using GPIO buttons and LEDs");
@@ -17,24 +68,330 @@ module_param(enable_gpio, bool, 0);
 MODULE_PARM_DESC(enable_gpio, "Enable/disable GPIO access (for debugging)");
 
 /**
- * Set up LEDs -- one per binary digit, low bit first
+ * Simulated GPIO -- with GPIO disabled, line writes can instead be
+ * recorded in an in-memory trace, and edges injected through sysfs, so 
+ * the output path can be exercised and timed without hardware
  */
 
-#define MAX_LEDS 8
-static uint8_t led_count = 0;
-static struct {
+static bool sim_gpio = false;
+module_param(sim_gpio, bool, 0444);
+MODULE_PARM_DESC(sim_gpio, "Record line writes when GPIO is disabled");
+
+static unsigned int sim_trace_len = 1024;
+module_param(sim_trace_len, uint, 0444);
+MODULE_PARM_DESC(sim_trace_len, "Number of simulated line writes to keep");
+
+struct sim_write {
+	uint64_t ts_ns;
+	unsigned int gpio;
+	uint8_t value;
+};
+
+static struct sim_write *sim_trace = NULL;
+static unsigned int sim_trace_head = 0; // next entry to write
+static unsigned int sim_trace_filled = 0;
+static uint64_t sim_writes = 0; // total, including overwritten entries
+static DEFINE_SPINLOCK(sim_lock);
+
+static int
+init_sim_gpio(void)
+{
+	if (enable_gpio || !sim_gpio || sim_trace_len == 0) {
+		return 0;
+	}
+	sim_trace = vzalloc(sim_trace_len * sizeof(*sim_trace));
+	if (!sim_trace) {
+		printk(KERN_ALERT "gpiocount: failed to allocate simulation trace\n");
+		return -ENOMEM;
+	}
+	printk(KERN_INFO "gpiocount: simulating GPIO with a trace of %u writes\n",
+		sim_trace_len);
+	return 0;
+}
+
+static void
+free_sim_gpio(void)
+{
+	vfree(sim_trace);
+	sim_trace = NULL;
+}
+
+static void
+sim_record_write(unsigned int gpio, uint8_t value)
+{
+	unsigned long flags;
+	spin_lock_irqsave(&sim_lock, flags);
+	struct sim_write *w = &sim_trace[sim_trace_head];
+	w->ts_ns = ktime_get_ns();
+	w->gpio = gpio;
+	w->value = value;
+	if (++sim_trace_head == sim_trace_len) {
+		sim_trace_head = 0;
+	}
+	if (sim_trace_filled < sim_trace_len) {
+		sim_trace_filled++;
+	}
+	sim_writes++;
+	spin_unlock_irqrestore(&sim_lock, flags);
+}
+
+/**
+ * Drive an output line -- the real GPIO, the simulation trace, or nothing
+ */
+static void
+line_set(unsigned int gpio, uint8_t value)
+{
+	if (enable_gpio) {
+		gpio_set_value(gpio, value);
+	} else if (sim_trace) {
+		sim_record_write(gpio, value);
+	}
+}
+
+/**
+ * Held by the sysfs stores that assign or free GPIOs, IRQs and the LED 
+ * and input arrays, and by the state restore, so that two writers never
+ * unassign or free the same thing at once. Never taken in a handler
+ */
+static DEFINE_MUTEX(config_mutex);
+
+/**
+ * Set up LEDs -- one per binary digit, low bit first, in one or more
+ * display groups that each show a slice of the value, from a bit offset 
+ * and in an encoding of their own -- or, in the bar encodings, show the
+ * button's pulse rate as a thermometer bar instead. All groups' LEDs share one array, sized
+ * when they are assigned, and with GPIO enabled their descriptors are kept
+ * contiguous, ordered by chip, so that all LEDs are written with one
+ * batched call that reaches each chip once. The button handler and the
+ * housekeeping timer touch the arrays only under led_lock and while
+ * leds_live is set, which assignment sets last and unassignment clears
+ * first, so they never see the arrays half built or freed
+ */
+
+#define MAX_LEDS 64 // per group -- the width of the counter
+#define MAX_LED_LINES 128
+#define MAX_DISPLAY_GROUPS 4
+
+#define DISPLAY_BAR_DEFAULT_HZ 10
+
+enum display_encoding {
+	DISPLAY_BINARY,
+	DISPLAY_GRAY, // one LED changes per increment
+	DISPLAY_BAR, // rate, linear up to full scale
+	DISPLAY_LOG_BAR, // rate, each LED twice the rate of the one below
+	DISPLAY_ENCODINGS,
+};
+
+static const char *display_encoding_names[DISPLAY_ENCODINGS] = {
+	"binary", "gray", "bar", "logbar"
+};
+
+static struct display_group {
+	uint8_t first; // index of the group's lowest LED in led_values
+	uint8_t count;
+	uint8_t offset; // bit of the value shown on the lowest LED
+	enum display_encoding encoding;
+	// bar encodings only -- refreshed from housekeeping, not per pulse
+	uint32_t full_hz;
+	uint8_t lit; // LEDs currently lit
+	uint64_t thresholds[MAX_LEDS]; // rate in mHz that lights each LED
+} display_groups[MAX_DISPLAY_GROUPS];
+static unsigned int display_group_count __read_mostly = 0;
+
+static uint8_t led_count __read_mostly = 0;
+static struct gpiocount_led {
 	bool on;
-	uint8_t gpio;
-} led_values[MAX_LEDS];
-static uint8_t gpio_increment_button = 0;
+	unsigned int gpio;
+} *led_values __read_mostly = NULL;
+static struct gpio_desc **led_descs __read_mostly = NULL; // only with GPIO enabled
+static uint8_t *led_order __read_mostly = NULL; // index in led_values of each led_descs
+static unsigned long *led_bits = NULL; // staging for the batched write
+static DEFINE_SPINLOCK(led_lock);
+static bool leds_live = false; // arrays complete, see above
+
+static void
+free_leds(void)
+{
+	kfree(led_values);
+	kfree(led_descs);
+	kfree(led_order);
+	bitmap_free(led_bits);
+	led_values = NULL;
+	led_descs = NULL;
+	led_order = NULL;
+	led_bits = NULL;
+}
+
+static int
+alloc_leds(unsigned int count)
+{
+	led_values = kcalloc(count, sizeof(*led_values), GFP_KERNEL);
+	led_bits = bitmap_zalloc(count, GFP_KERNEL);
+	if (enable_gpio) {
+		led_descs = kcalloc(count, sizeof(*led_descs), GFP_KERNEL);
+		led_order = kcalloc(count, sizeof(*led_order), GFP_KERNEL);
+	}
+	if (!led_values || !led_bits || 
+		(enable_gpio && (!led_descs || !led_order))) {
+		free_leds();
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+static bool
+display_is_bar(const struct display_group *g)
+{
+	return GPIOCOUNT_BARS && 
+		(g->encoding == DISPLAY_BAR || g->encoding == DISPLAY_LOG_BAR);
+}
+
+static int
+parse_display_encoding(const char *name)
+{
+	int e = match_string(display_encoding_names, DISPLAY_ENCODINGS, name);
+	if (!GPIOCOUNT_BARS && (e == DISPLAY_BAR || e == DISPLAY_LOG_BAR)) {
+		return -EINVAL;
+	}
+	return e;
+}
+
+/**
+ * Precompute the rate at which each LED of a bar lights, so a refresh 
+ * only compares -- the top LED lights at full scale
+ */
+static void
+setup_bar_thresholds(struct display_group *g)
+{
+	uint64_t full_millihz = (uint64_t)g->full_hz * 1000;
+	for (unsigned int i = 0; i < g->count; i++) {
+		uint64_t t = g->encoding == DISPLAY_LOG_BAR ? 
+			full_millihz >> (g->count - 1 - i) : 
+			div_u64(full_millihz * (i + 1), g->count);
+		g->thresholds[i] = t ? t : 1; // nothing lit at rest
+	}
+	g->lit = 0;
+}
+
+/**
+ * Order the descriptors by chip -- a chip's descriptors sit in one array
+ * of its own, so sorting by address groups them, and the batched write
+ * then makes one call per chip rather than one per run of lines
+ */
+static void
+order_led_descs(void)
+{
+	for (unsigned int i = 0; i < led_count; i++) {
+		struct gpio_desc *desc = gpio_to_desc(led_values[i].gpio);
+		unsigned int j = i;
+		for (; j > 0 && led_descs[j - 1] > desc; j--) {
+			led_descs[j] = led_descs[j - 1];
+			led_order[j] = led_order[j - 1];
+		}
+		led_descs[j] = desc;
+		led_order[j] = i;
+	}
+}
+
+/**
+ * Drive every LED from led_values -- or switch them all off when blank
+ */
+static void
+write_leds(bool blank)
+{
+	if (led_descs) {
+		for (int j = 0; j < led_count; j++) {
+			__assign_bit(j, led_bits, !blank && led_values[led_order[j]].on);
+		}
+		gpiod_set_array_value(led_count, led_descs, NULL, led_bits);
+		return;
+	}
+	for (int i = 0; i < led_count; i++) {
+		line_set(led_values[i].gpio, !blank && led_values[i].on ? 1 : 0);
+	}
+}
+
+/**
+ * Counter inputs -- input 0 is the increment button, which also drives 
+ * the displayed value, and the rest are extra counters assigned through
+ * gpio_inputs. Each input is passed to its handler as dev_id, so inputs
+ * can share an interrupt line
+ */
+
+static unsigned int max_inputs = 32;
+module_param(max_inputs, uint, 0444);
+MODULE_PARM_DESC(max_inputs, "Maximum number of counter inputs, including the button");
+
+/**
+ * Recent pulse counts in 2^30 ns (about one second) buckets, each tagged 
+ * with the bucket number it holds -- updated in O(1) per pulse, with 
+ * stale buckets discarded when written or read, so idle inputs cost
+ * nothing and no timer is needed
+ */
+#define RATE_BUCKET_SHIFT 30
+#define RATE_BUCKETS 8
+
+struct gpiocount_rate {
+	uint32_t slot[RATE_BUCKETS];
+	uint32_t count[RATE_BUCKETS];
+};
+
+/**
+ * Conversion of a pulse count to engineering units (litres, kWh, ...),
+ * applied only when read -- counts are scaled in thousandths of a unit
+ * with integer arithmetic, so there is no floating point anywhere and
+ * the pulse path is unchanged
+ */
+struct gpiocount_scale {
+	uint32_t milli_pulses; // pulses per unit, in thousandths -- 0 is unscaled
+	int64_t offset_milli; // added to the scaled count, in thousandths
+};
+
+#define MAX_TARIFFS 4
 
 /**
- * Counter state
+ * Each input is laid out as a write-hot block, written on every edge by 
+ * whichever CPU takes its interrupt, then on a cache line of its own the
+ * read-mostly block that only changes when the input is configured. The
+ * whole struct is cache-line aligned, so inputs interrupted on different
+ * CPUs never share a line, and sysfs reads of the configuration do not
+ * pull lines away from the interrupt path
  */
+struct gpiocount_input {
+	// write-hot
+	uint8_t level; // last seen line state, to demultiplex a shared IRQ
+	uint64_t count; // accepted presses
+	uint64_t tariff_counts[MAX_TARIFFS]; // accepted presses per tariff
+	seqcount_t seq; // bumped around a press's count and tariff update
+	struct gpiocount_rate rate;
+	struct gc_debounce debounce;
+
+	// read-mostly
+	uint16_t index ____cacheline_aligned_in_smp;
+	unsigned int gpio;
+	unsigned int irq;
+	bool assigned; // GPIO and IRQ are set up
+	bool irq_threaded; // line can sleep, so read it from a thread
+	struct gpiocount_scale scale;
+} ____cacheline_aligned_in_smp;
+
+static struct gpiocount_input *inputs __read_mostly = NULL;
+static unsigned int input_count __read_mostly = 1; // the button always has a slot
+static unsigned long *stalled_inputs = NULL; // bitmap, see scan_stalls()
 
-static uint8_t value = 0; // displayed in LEDs
-static uint8_t max_value = 0; // not displayed
-static uint8_t max_possible = 0; // max possible with current LEDs
+/**
+ * Counter state -- written on every press of the button, with the LED 
+ * state the press path updates -- kept together, and apart from the read-mostly settings
+ * around them, so that a press dirties one cache line and a reader of
+ * those settings on another CPU is not invalidated by it
+ */
+static struct {
+	uint64_t value; // displayed in LEDs
+	uint64_t max_value; // not displayed
+	unsigned long last_display_jiffies; // last LED update
+	bool leds_blanked; // LEDs switched off after inactivity
+} counter ____cacheline_aligned_in_smp;
+static uint64_t max_possible __read_mostly = 0; // max possible with current LEDs
 
 /**
  * Increment the value, setting max_value if needed, and 
@@ -43,14 +400,14 @@ static uint8_t max_possible = 0; // max possible with current LEDs
  */
 static bool
 increment_maybe_wrap(void) {
-	if (value < max_possible) {
-		value++;
-		if (value > max_value) {
-			max_value++;
+	if (counter.value < max_possible) {
+		counter.value++;
+		if (counter.value > counter.max_value) {
+			counter.max_value++;
 		}
 		return false;
 	} else {
-		value = 0;
+		counter.value = 0;
 		return true;
 	}
 }
@@ -58,31 +415,99 @@ increment_maybe_wrap(void) {
 static void
 zero_counters(void) 
 {
-	value = 0;
+	counter.value = 0;
 	// let max_value stay as a record
 	max_possible = 0;
 }
 
+/**
+ * The value wraps when the group showing its highest bit runs out -- bars
+ * show the rate, so they do not count
+ */
 static void
 setup_max_possible(void)
 {
+	unsigned int bits = 0;
+	for (unsigned int g = 0; g < display_group_count; g++) {
+		if (display_is_bar(&display_groups[g])) {
+			continue;
+		}
+		bits = max(bits, 
+			(unsigned int)display_groups[g].offset + display_groups[g].count);
+	}
 	max_possible = 0;
-	for (int i = 0; i < led_count; i++) {
+	for (unsigned int i = 0; i < bits && i < 64; i++) {
 		max_possible = (max_possible << 1) | 1; 
 	}
-	if (value > max_possible) {
-		value = 0;
+	if (counter.value > max_possible) {
+		counter.value = 0;
 	}
-	printk(KERN_INFO "gpiocount: set max_possible = %u\n", max_possible);
-	printk(KERN_INFO "gpiocount: new value = %u\n", value);
+	printk(KERN_INFO "gpiocount: set max_possible = %llu\n", 
+		(unsigned long long)max_possible);
+	printk(KERN_INFO "gpiocount: new value = %llu\n", 
+		(unsigned long long)counter.value);
 }
 
-#define GPIO_MAX_DIGITS 3
+/**
+ * Parse one group -- "<gpio>,<gpio>,...[:<offset>[:<encoding>]]" -- 
+ * appending its LEDs to led_values
+ */
+static int
+parse_display_group(char *spec, struct display_group *g, unsigned int max)
+{
+	char *gpios = strsep(&spec, ":");
+	char *offset = strsep(&spec, ":");
+	char *encoding = strsep(&spec, ":");
+	char *full_hz = strsep(&spec, ":");
+	unsigned int offset_bits = 0;
+	g->full_hz = DISPLAY_BAR_DEFAULT_HZ;
+	if (full_hz && (kstrtouint(full_hz, 10, &g->full_hz) || !g->full_hz)) {
+		return -EINVAL;
+	}
+	if (offset && *offset && 
+		(kstrtouint(offset, 10, &offset_bits) || offset_bits > 63)) {
+		return -EINVAL;
+	}
+	g->encoding = DISPLAY_BINARY;
+	if (encoding) {
+		int e = parse_display_encoding(encoding);
+		if (e < 0) {
+			return -EINVAL;
+		}
+		g->encoding = e;
+	}
+	g->first = led_count;
+	char *token;
+	while ((token = strsep(&gpios, ",")) != NULL) {
+		unsigned int gpio;
+		if (kstrtouint(token, 10, &gpio)) {
+			printk(KERN_INFO "gpiocount: bad LED GPIO '%s'\n", token);
+			return -EINVAL;
+		}
+		if (led_count == max) {
+			return -EINVAL;
+		}
+		led_values[led_count].gpio = gpio;
+		led_values[led_count].on = false;
+		led_count++;
+	}
+	g->count = led_count - g->first;
+	if (g->count > MAX_LEDS || offset_bits + g->count > 64) {
+		printk(KERN_INFO "gpiocount: LED group past bit 64\n");
+		return -EINVAL;
+	}
+	g->offset = offset_bits;
+	if (display_is_bar(g)) {
+		g->offset = 0;
+		setup_bar_thresholds(g);
+	}
+	return 0;
+}
 
 /**
- * Parse a LED digit GPIO assignment string and validate, 
- * then set up structures and initialize the LEDs 
- * (if GPIO is enabled) -- must be called with no digits assigned
+ * Parse a LED GPIO assignment string -- one or more display groups 
+ * separated by ';' -- and validate, then set up structures and initialize
+ * the LEDs (if GPIO is enabled) -- must be called with no digits assigned
  */
 static int 
 assign_leds(const char *led_desc) 
@@ -91,44 +516,37 @@ assign_leds(const char *led_desc)
 		printk(KERN_INFO "gpiocount: cannot assign LEDs when assigned\n");
 		return -EPERM; 
 	} 
-	const char *curr = led_desc;
-	char gpio_digits[GPIO_MAX_DIGITS + 1];
-	uint8_t next_digit = 0;
-	for (;;) {
-		char c = *curr;
-		if (c == ',' || c == '\0') {
-			// end of a number -- process it
-			if (next_digit == 0) {
-				led_count = 0;
-				printk(KERN_INFO "gpiocount: empty LED GPIO at %u\n", led_count);
-				return -EINVAL;
-			} else if (led_count >= MAX_LEDS) {
-				printk(KERN_INFO "gpiocount: too many LED GPIOs -- skipping rest \n");
-				break;
-			} else {
-				// go ahead
-			}
-			gpio_digits[next_digit] = '\0';
-			// parse and add
-			uint32_t ttt;
-			sscanf(gpio_digits, "%u", &ttt);
-			led_values[led_count].gpio = ttt;
-			led_values[led_count].on = false;
-			led_count++;
-			next_digit = 0;
-		} else {
-			// add the digit unless it's too many
-			if (next_digit >=  GPIO_MAX_DIGITS) {
-				led_count = 0;
-				printk(KERN_INFO "gpiocount: LED GPIO with too many digits\n");
-				return -EINVAL;
-			} 
-			gpio_digits[next_digit++] = c;
-		}
-		if (*curr == '\0') {
+	unsigned int gpios = 1;
+	for (const char *c = led_desc; *c; c++) {
+		gpios += *c == ',' || *c == ';';
+	}
+	if (gpios > MAX_LED_LINES) {
+		printk(KERN_INFO "gpiocount: more than %u LED GPIOs\n", MAX_LED_LINES);
+		return -EINVAL;
+	}
+	char *desc = kstrdup(led_desc, GFP_KERNEL);
+	if (!desc) {
+		return -ENOMEM;
+	}
+	int result = alloc_leds(gpios);
+	char *cursor = strim(desc);
+	char *spec;
+	while (!result && (spec = strsep(&cursor, ";")) != NULL) {
+		if (display_group_count == MAX_DISPLAY_GROUPS) {
+			printk(KERN_INFO "gpiocount: more than %u LED groups\n", 
+				MAX_DISPLAY_GROUPS);
+			result = -EINVAL;
 			break;
 		}
-		curr++;
+		result = parse_display_group(spec, 
+			&display_groups[display_group_count++], gpios);
+	}
+	kfree(desc);
+	if (result) {
+		led_count = 0;
+		display_group_count = 0;
+		free_leds();
+		return result;
 	}
 	setup_max_possible();
 	if (enable_gpio) {
@@ -139,17 +557,25 @@ assign_leds(const char *led_desc)
 				printk(KERN_INFO "gpiocount: invalid LED GPIO %u -- releasing all\n", led_values[i].gpio);
 				// assumption: all the prior ones were successful
 				// so we can and should release them
-				for (uint8_t j = j; j < i; j++) {
+				for (uint8_t j = 0; j < i; j++) {
 					gpio_set_value(led_values[j].gpio, 0);
 					gpio_free(led_values[j].gpio);
 				}
+				led_count = 0;
+				display_group_count = 0;
+				free_leds();
 				zero_counters();
 				return -ENODEV;
 			}
 
 			gpio_direction_output(led_values[i].gpio, 0);
 		}
+		order_led_descs();
 	}
+	unsigned long flags;
+	spin_lock_irqsave(&led_lock, flags);
+	leds_live = true;
+	spin_unlock_irqrestore(&led_lock, flags);
 	return 0;
 }
 
@@ -161,285 +587,2994 @@ assign_leds(const char *led_desc)
 static int 
 unassign_leds(void) 
 {
-	if (enable_gpio) {
-		for (uint8_t i = 0; i < led_count; i++) {
+	// once this returns no handler is using the arrays, or will
+	unsigned long flags;
+	spin_lock_irqsave(&led_lock, flags);
+	leds_live = false;
+	spin_unlock_irqrestore(&led_lock, flags);
+	for (uint8_t i = 0; i < led_count; i++) {
+		line_set(led_values[i].gpio, 0);
+		if (enable_gpio) {
 			printk(KERN_INFO "gpiocount: releasing LED on GPIO %d\n", 
 				led_values[i].gpio);
-			gpio_set_value(led_values[i].gpio, 0);
 			gpio_unexport(led_values[i].gpio);
 			gpio_free(led_values[i].gpio);
 		}
 	}
 	led_count = 0;
+	display_group_count = 0;
+	free_leds();
 	return 0;
 }
 
 /**
- * Use the current value to set the boolean values of all the LEDs and 
- * then, if GPIO is enabled, make sure the actual LEDs reflect these settings
+ * Handler cost accounting -- with profile_phases set, the interrupt path
+ * and set_leds_from_value() charge the cycles spent in each phase to a
+ * per-CPU table, so charging takes no lock and shares no cache line. The
+ * sums are read, and reset by any write, through the debugfs entry
+ * gpiocount/profile. Where get_cycles() has no counter to read, the
+ * table is kept in nanoseconds instead
  */
-static int 
-set_leds_from_value(void) {
-	// since the low bits are first, just shift each low bit out 
-	// of the value and use it 
-	printk(KERN_INFO "gpiocount: representing value %u\n", value); 
-	uint8_t bits = value;
-	for (int i = 0; i < led_count; i++) {
-		uint8_t bit = bits & 0x1;
-		bits = bits >> 1;
-		led_values[i].on = (bit == 0x1);
-		printk(KERN_INFO "gpiocount: bit %d is %s\n", 
-				i, led_values[i].on ? "on" : "off");
-	}
-	if (enable_gpio) {
-		for (int i = 0; i < led_count; i++) {
-			gpio_set_value(led_values[i].gpio, led_values[i].on ? 1 : 0);
-		}
-	}
-	return 0;
-}
 
-/**
- * Buttond ebouncing logic
- */
-static unsigned int last_interrupt_time_msec = 0;
-static uint64_t epoch_msec; // to keep numbers small
+enum profile_phase {
+	PROFILE_TIMESTAMP, // reading the level and timestamping the edge
+	PROFILE_EVENT, // recording the edge in the event ring
+	PROFILE_DEBOUNCE,
+	PROFILE_COUNT, // counter, rate and tariff updates
+	PROFILE_ENCODE, // working out the LED values
+	PROFILE_LED_WRITE,
+	PROFILE_NOTIFY, // gesture classification and sysfs_notify()
+	PROFILE_PHASES,
+};
 
-/**
- * Initialize epoch time
- */
-static void 
-init_debounce(void) 
-{
-	struct timeval tv;
-  	do_gettimeofday(&tv);
-	epoch_msec = (uint64_t)tv.tv_sec * (uint64_t)1000 + (uint64_t)(tv.tv_usec / 1000);
-}
+#if GPIOCOUNT_PROFILE
 
-/**
- * Time (in msec) since epoch, for debouncing
- */
-static unsigned int since_epoch_msec(void)
-{
-  struct timeval tv;
-  uint64_t now;
+static const char *profile_phase_names[PROFILE_PHASES] = {
+	"timestamp", "event", "debounce", "count", "encode", "led_write", "notify"
+};
+
+static bool profile_phases = false;
+module_param(profile_phases, bool, 0644);
+MODULE_PARM_DESC(profile_phases, "Account handler cycles per phase in debugfs");
+
+struct gpiocount_profile {
+	uint64_t calls[PROFILE_PHASES];
+	uint64_t cycles[PROFILE_PHASES];
+	uint64_t max[PROFILE_PHASES];
+};
 
-  do_gettimeofday(&tv);
-  now = (uint64_t)tv.tv_sec * (uint64_t)1000 + (uint64_t)(tv.tv_usec / 1000);
+static DEFINE_PER_CPU(struct gpiocount_profile, profile);
+static bool profile_ns __read_mostly = false; // no cycle counter
+static struct dentry *debugfs_dir = NULL;
 
-  return (uint32_t)(now - epoch_msec);
+static inline uint64_t
+profile_clock(void)
+{
+	return profile_ns ? ktime_get_ns() : (uint64_t)get_cycles();
 }
 
 /**
- * Button handler
+ * Start timing the phases of one call -- 0 when profiling is off, which
+ * makes every profile_charge() of the call a single test
  */
-
-static unsigned int increment_irq = 0;
-
-static irq_handler_t 
-button_irq_handler(unsigned int irq, void *dev_id, struct pt_regs *regs) { 
-	printk(KERN_INFO "gpiocount: entering handler\n");
-	unsigned int interrupt_time_msec = since_epoch_msec();
-
-   	if (interrupt_time_msec - last_interrupt_time_msec < 200) 
-   	{
-     	printk(KERN_INFO "gpiocount: ignored interrupt [%d]%s \n",
-          irq, (char *) dev_id);
-     	return (irq_handler_t) IRQ_HANDLED;
-   	}
-   	last_interrupt_time_msec = interrupt_time_msec;
-	increment_maybe_wrap();
-	set_leds_from_value();
-	printk(KERN_INFO "gpiocount: exiting handler\n");
-   	return (irq_handler_t) IRQ_HANDLED;
+static inline uint64_t
+profile_start(void)
+{
+	return profile_phases ? profile_clock() : 0;
 }
 
-/** 
- * Invariant: no button is currently set up
+/**
+ * Charge the time since *start to a phase, and start timing the next
  */
-static int 
-assign_increment_button(void)
+static inline void
+profile_charge(enum profile_phase phase, uint64_t *start)
 {
-	if (enable_gpio) {
-
-		if (!gpio_is_valid(gpio_increment_button)) {
-			printk(KERN_INFO "gpiocount: invalid button GPIO\n");
-			return -EINVAL;
-		}
-		gpio_direction_input(gpio_increment_button);
-		// TODO: seems like this made it worse!
-		int result = gpio_set_debounce(gpio_increment_button, 200);
-		if (result) {
-			printk(KERN_INFO "gpiocount: attempt to debounce returned %d\n", result); 
-		} else {
-			printk(KERN_INFO "gpiocount: debounce ok\n"); 
-		}
-
-		increment_irq = gpio_to_irq(gpio_increment_button);
-   		printk(KERN_INFO "gpiocount: The button is mapped to IRQ: %d\n", increment_irq);
-
-		result = request_irq(increment_irq,
-                        (irq_handler_t) button_irq_handler,
-                        IRQF_TRIGGER_RISING,
-                        "gpiocount_handler",
-                        NULL);
-
-		if (result) {
-			printk(KERN_INFO "gpiocount: The interrupt request result is: %d\n", result);   
-			return result;
-		}
+	if (!*start) {
+		return;
 	}
-	
-	return 0;
+	uint64_t now = profile_clock();
+	uint64_t spent = now - *start;
+	struct gpiocount_profile *p = get_cpu_ptr(&profile);
+	p->calls[phase]++;
+	p->cycles[phase] += spent;
+	if (spent > p->max[phase]) {
+		p->max[phase] = spent;
+	}
+	put_cpu_ptr(&profile);
+	*start = now;
 }
 
 static int
-unassign_increment_button(void) 
+profile_show(struct seq_file *m, void *v)
 {
-	if (enable_gpio) {
-		if (gpio_increment_button > 0) {
-			printk(KERN_INFO "gpiocount: releasing increment button on GPIO %d\n", 
-				gpio_increment_button);
-			free_irq(increment_irq, NULL);
-			gpio_unexport(gpio_increment_button);
-			gpio_free(gpio_increment_button);
+	struct gpiocount_profile sum;
+	uint64_t total = 0;
+	int cpu;
+	memset(&sum, 0, sizeof(sum));
+	for_each_possible_cpu(cpu) {
+		const struct gpiocount_profile *p = per_cpu_ptr(&profile, cpu);
+		for (int i = 0; i < PROFILE_PHASES; i++) {
+			sum.calls[i] += p->calls[i];
+			sum.cycles[i] += p->cycles[i];
+			sum.max[i] = max(sum.max[i], p->max[i]);
 		}
 	}
+	for (int i = 0; i < PROFILE_PHASES; i++) {
+		total += sum.cycles[i];
+	}
+	seq_printf(m, "unit %s\n", profile_ns ? "ns" : "cycles");
+	seq_printf(m, "%-10s %12s %16s %10s %10s %6s\n", 
+		"phase", "calls", "total", "mean", "max", "share");
+	for (int i = 0; i < PROFILE_PHASES; i++) {
+		seq_printf(m, "%-10s %12llu %16llu %10llu %10llu %5llu%%\n", 
+			profile_phase_names[i], 
+			(unsigned long long)sum.calls[i], 
+			(unsigned long long)sum.cycles[i], 
+			(unsigned long long)(sum.calls[i] ? 
+				div64_u64(sum.cycles[i], sum.calls[i]) : 0), 
+			(unsigned long long)sum.max[i], 
+			(unsigned long long)(total ? 
+				div64_u64(sum.cycles[i] * 100, total) : 0));
+	}
 	return 0;
 }
 
-/**
- * Unassign all dyanmically defined buttons
- */
 static int
-unassign_buttons(void) 
+profile_open(struct inode *inode, struct file *file)
 {
-	int result = unassign_increment_button();
-	if (result) return result;
-	return 0;
+	return single_open(file, profile_show, NULL);
 }
 
 /**
- * Set up sysfs integration
+ * Any write zeroes the table -- charges racing with it on other CPUs may
+ * survive, which is harmless for a diagnostic
  */
+static ssize_t
+profile_write(struct file *file, const char __user *buf, size_t count, 
+	loff_t *pos)
+{
+	int cpu;
+	for_each_possible_cpu(cpu) {
+		memset(per_cpu_ptr(&profile, cpu), 0, sizeof(struct gpiocount_profile));
+	}
+	return count;
+}
 
-static struct kobject *gpiocount_kobj = NULL; 
+static const struct file_operations profile_fops = {
+	.owner = THIS_MODULE,
+	.open = profile_open,
+	.read = seq_read,
+	.write = profile_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
 
-static ssize_t value_show(struct kobject *kobj, 
-	struct kobj_attribute *attr, char *buf)
+static void
+init_profile(void)
 {
-   	return sprintf(buf, "%u\n", value);
+	profile_ns = get_cycles() == 0;
+	// debugfs is optional -- the module works the same without it
+	debugfs_dir = debugfs_create_dir("gpiocount", NULL);
+	debugfs_create_file("profile", 0600, debugfs_dir, NULL, &profile_fops);
 }
 
-static ssize_t value_store(struct kobject *kobj, 
-	struct kobj_attribute *attr,
-    const char *buf, size_t count)
+static void
+free_profile(void)
 {
-	uint32_t t;
-   	sscanf(buf, "%u", &t);
-	value = t;
-	printk(KERN_INFO "gpiocount: 'value' set to %d via sysfs\n", value);
-	set_leds_from_value();
-   	return count;
+	debugfs_remove_recursive(debugfs_dir);
+	debugfs_dir = NULL;
 }
 
-static ssize_t max_value_show(struct kobject *kobj, 
-	struct kobj_attribute *attr, char *buf)
+#else
+
+static inline uint64_t
+profile_start(void)
 {
-   	return sprintf(buf, "%u\n", max_value);
+	return 0;
 }
 
-static ssize_t max_value_store(struct kobject *kobj, 
-	struct kobj_attribute *attr,
-    const char *buf, size_t count)
+static inline void
+profile_charge(enum profile_phase phase, uint64_t *start)
 {
-	uint32_t t;
-   	sscanf(buf, "%u", &t);
-	max_value = t;
-	printk(KERN_INFO "gpiocount: 'max_value' set to %d via sysfs\n", 
-		max_value);
-   	return count;
 }
 
-static ssize_t gpio_leds_show(struct kobject *kobj, 
-	struct kobj_attribute *attr, char *buf)
+static void
+init_profile(void)
 {
-	int length = 0;
-	for (int i = 0; i < led_count; i++) {
-		if (i != 0) {
-			length += sprintf(buf + length, ",");
-		}
-		length += sprintf(buf + length, "%u", led_values[i].gpio);
-	}
-	length += sprintf(buf + length, "\n");
-   	return length;
 }
 
-static ssize_t gpio_leds_store(struct kobject *kobj, 
-	struct kobj_attribute *attr,
-    const char *buf, size_t count)
+static void
+free_profile(void)
 {
-	printk(KERN_INFO "gpiocount: reloading LED GPIOs\n");
-	unassign_leds();
-	assign_leds(buf);
+}
+
+#endif
+
+/**
+ * Use the current value to set the boolean values of all the LEDs and 
+ * then make sure the actual (or simulated) LEDs reflect these settings
+ */
+static unsigned int idle_blank_sec __read_mostly = 0; // 0 leaves the LEDs on
+static struct timer_list housekeeping_timer; // see housekeeping()
+
+static uint64_t
+display_encode(enum display_encoding encoding, uint64_t v)
+{
+	switch (encoding) {
+	case DISPLAY_GRAY:
+		return v ^ (v >> 1);
+	default:
+		return v;
+	}
+}
+
+static int 
+set_leds_from_value(void) {
+	uint64_t t = profile_start();
+	unsigned long flags;
+	spin_lock_irqsave(&led_lock, flags);
+	if (!leds_live) {
+		spin_unlock_irqrestore(&led_lock, flags);
+		return 0;
+	}
+	// every group is set from the same snapshot of the value
+	uint64_t snapshot = counter.value;
+	if (GPIOCOUNT_VERBOSE) {
+		printk(KERN_INFO "gpiocount: representing value %llu\n", 
+			(unsigned long long)snapshot); 
+	}
+	bool shown = false; // some group shows the value
+	for (unsigned int g = 0; g < display_group_count; g++) {
+		const struct display_group *group = &display_groups[g];
+		if (display_is_bar(group)) {
+			continue; // left as housekeeping last set it
+		}
+		shown = true;
+		// since the low bits are first, just shift each low bit out 
+		// of the value and use it 
+		uint64_t bits = display_encode(group->encoding, snapshot) >> 
+			group->offset;
+		for (int i = group->first; i < group->first + group->count; i++) {
+			uint64_t bit = bits & 0x1;
+			bits = bits >> 1;
+			led_values[i].on = (bit == 0x1);
+			if (GPIOCOUNT_VERBOSE) {
+				printk(KERN_INFO "gpiocount: bit %d is %s\n", 
+						i, led_values[i].on ? "on" : "off");
+			}
+		}
+	}
+	profile_charge(PROFILE_ENCODE, &t);
+	// with only bars shown the value changes nothing, unless LEDs are blank
+	if (shown || counter.leds_blanked) {
+		write_leds(false);
+	}
+	profile_charge(PROFILE_LED_WRITE, &t);
+	counter.leds_blanked = false;
+	counter.last_display_jiffies = jiffies;
+	if (idle_blank_sec) {
+		// the timer stops once the LEDs are blank, and may be armed for
+		// a later deadline; timer_reduce leaves an earlier one alone
+		timer_reduce(&housekeeping_timer, 
+			round_jiffies(jiffies + idle_blank_sec * HZ));
+	}
+	spin_unlock_irqrestore(&led_lock, flags);
+	return 0;
+}
+
+/**
+ * Input debouncing logic -- see gpiocount_debounce.h. The settings are
+ * shared by all inputs, and input 0 (the button) is the one reported
+ */
+
+static void
+free_inputs(void)
+{
+	kfree(inputs);
+	bitmap_free(stalled_inputs);
+	inputs = NULL;
+	stalled_inputs = NULL;
+}
+
+static int 
+init_inputs(void) 
+{
+	if (max_inputs < 1 || max_inputs > U16_MAX) {
+		printk(KERN_INFO "gpiocount: max_inputs must be 1 to %u\n", U16_MAX);
+		return -EINVAL;
+	}
+	inputs = kcalloc(max_inputs, sizeof(*inputs), GFP_KERNEL);
+	stalled_inputs = bitmap_zalloc(max_inputs, GFP_KERNEL);
+	if (!inputs || !stalled_inputs) {
+		free_inputs();
+		return -ENOMEM;
+	}
+	for (unsigned int i = 0; i < max_inputs; i++) {
+		inputs[i].index = i;
+		seqcount_init(&inputs[i].seq);
+	}
+	gc_debounce_init(&inputs[0].debounce, 
+		GC_DEBOUNCE_DEFAULT_MSEC * NSEC_PER_MSEC);
+	return 0;
+}
+
+/**
+ * Give an input the button's debounce settings, with fresh state
+ */
+static void
+copy_debounce_settings(struct gpiocount_input *in)
+{
+	const struct gc_debounce *from = &inputs[0].debounce;
+	struct gc_debounce *d = &in->debounce;
+	gc_debounce_init(d, from->window_ns);
+	d->release_window_ns = from->release_window_ns;
+	d->min_pulse_ns = from->min_pulse_ns;
+	if (from->adapt_percentile) {
+		gc_debounce_adapt(d, from->adapt_percentile, from->adapt_margin_ns,
+			from->adapt_min_ns, from->adapt_max_ns);
+	}
+}
+
+/**
+ * Edge event ring -- every raw edge seen by the handler, before debouncing,
+ * kept either as full records or as compact delta-encoded blocks
+ */
+
+static unsigned int event_ring_kb = 0;
+static bool compact_events = false;
+#if GPIOCOUNT_EVENTS
+module_param(event_ring_kb, uint, 0444);
+MODULE_PARM_DESC(event_ring_kb, "Size of the edge event ring in KiB (0 to disable)");
+module_param(compact_events, bool, 0444);
+MODULE_PARM_DESC(compact_events, "Store edge events as delta-encoded blocks");
+#endif
+
+static void *event_ring = NULL; // struct gc_event[] or struct gc_event_block[]
+static size_t event_slot_size = 0;
+static unsigned int event_slots = 0;
+static unsigned int event_head = 0; // full: next slot, compact: current block
+static unsigned int event_filled = 0; // slots holding data
+static uint32_t event_seq = 0;
+static struct gc_event_writer event_writer;
+static DEFINE_SPINLOCK(event_lock);
+
+static int
+init_event_ring(void)
+{
+	if (!GPIOCOUNT_EVENTS || event_ring_kb == 0) {
+		return 0;
+	}
+	event_slot_size = compact_events ? 
+		sizeof(struct gc_event_block) : sizeof(struct gc_event);
+	event_slots = (event_ring_kb * 1024) / event_slot_size;
+	event_ring = vzalloc(event_slots * event_slot_size);
+	if (!event_ring) {
+		printk(KERN_ALERT "gpiocount: failed to allocate event ring\n");
+		event_slots = 0;
+		return -ENOMEM;
+	}
+	printk(KERN_INFO "gpiocount: event ring of %u %s\n", event_slots,
+		compact_events ? "compact blocks" : "records");
+	return 0;
+}
+
+static void
+free_event_ring(void)
+{
+	vfree(event_ring);
+	event_ring = NULL;
+	event_slots = 0;
+}
+
+/**
+ * Append an edge to the ring, overwriting the oldest record (or, in
+ * compact mode, the oldest block) when full -- safe from the handler
+ */
+static void
+record_event(uint64_t ts_ns, uint16_t input, uint8_t level)
+{
+	if (!GPIOCOUNT_EVENTS || !event_ring) {
+		return;
+	}
+	unsigned long flags;
+	spin_lock_irqsave(&event_lock, flags);
+	struct gc_event e = {
+		.ts_ns = ts_ns,
+		.seq = event_seq++,
+		.input = input,
+		.level = level,
+	};
+	if (compact_events) {
+		struct gc_event_block *blocks = event_ring;
+		if (event_filled == 0 || 
+			!gc_block_append(&blocks[event_head], &event_writer, &e)) {
+			if (event_filled > 0 && ++event_head == event_slots) {
+				event_head = 0;
+			}
+			gc_block_start(&blocks[event_head], &event_writer, &e);
+			if (event_filled < event_slots) {
+				event_filled++;
+			}
+		}
+	} else {
+		struct gc_event *records = event_ring;
+		records[event_head] = e;
+		if (++event_head == event_slots) {
+			event_head = 0;
+		}
+		if (event_filled < event_slots) {
+			event_filled++;
+		}
+	}
+	spin_unlock_irqrestore(&event_lock, flags);
+}
+
+#if GPIOCOUNT_EVENTS
+
+/**
+ * Copy out the ring oldest slot first, starting at byte offset pos
+ */
+static size_t
+read_events(char *buf, loff_t pos, size_t count)
+{
+	unsigned long flags;
+	spin_lock_irqsave(&event_lock, flags);
+	size_t total = (size_t)event_filled * event_slot_size;
+	// in compact mode the head block is the newest, not the next free one
+	unsigned int oldest = (event_head + event_slots - event_filled + 
+		(compact_events ? 1 : 0)) % event_slots;
+	size_t copied = 0;
+	while (pos + copied < total && copied < count) {
+		size_t logical = pos + copied;
+		unsigned int slot = (oldest + logical / event_slot_size) % event_slots;
+		size_t within = logical % event_slot_size;
+		size_t n = min(event_slot_size - within, count - copied);
+		memcpy(buf + copied, 
+			(char *)event_ring + slot * event_slot_size + within, n);
+		copied += n;
+	}
+	spin_unlock_irqrestore(&event_lock, flags);
+	return copied;
+}
+
+#endif
+
+/**
+ * Input handler -- shared by all inputs, which it tells apart by dev_id.
+ * On a shared line every sharer is called, so an input whose line state 
+ * has not changed since its last edge reports the interrupt as not its own
+ */
+
+static void
+rate_add(struct gpiocount_rate *r, uint64_t now_ns)
+{
+	uint32_t slot = (uint32_t)(now_ns >> RATE_BUCKET_SHIFT);
+	unsigned int i = slot & (RATE_BUCKETS - 1);
+	if (r->slot[i] != slot) {
+		r->slot[i] = slot;
+		r->count[i] = 0;
+	}
+	r->count[i]++;
+}
+
+/**
+ * Pulses per second, in thousandths, over the complete buckets still in
+ * the window plus the elapsed part of the current one
+ */
+static uint64_t
+rate_millihz(const struct gpiocount_rate *r, uint64_t now_ns)
+{
+	uint32_t slot = (uint32_t)(now_ns >> RATE_BUCKET_SHIFT);
+	uint64_t pulses = 0;
+	for (unsigned int i = 0; i < RATE_BUCKETS; i++) {
+		if (slot - r->slot[i] < RATE_BUCKETS) {
+			pulses += r->count[i];
+		}
+	}
+	uint64_t window_ns = ((uint64_t)(RATE_BUCKETS - 1) << RATE_BUCKET_SHIFT) + 
+		(now_ns & ((1ull << RATE_BUCKET_SHIFT) - 1));
+	return div64_u64(pulses * NSEC_PER_SEC * 1000, window_ns);
+}
+
+/**
+ * Total in thousandths of a unit -- split into quotient and remainder so
+ * that the result is exact. Totals beyond S64_MAX thousandths, such as
+ * above about 9.2e15 unscaled pulses or 1.8e13 pulses at milli_pulses=1,
+ * saturate at S64_MAX rather than wrapping negative
+ */
+static int64_t
+scale_milli(const struct gpiocount_scale *sc, uint64_t pulses)
+{
+	uint64_t milli;
+	if (!sc->milli_pulses) {
+		if (pulses > S64_MAX / 1000) {
+			return S64_MAX;
+		}
+		milli = pulses * 1000;
+	} else {
+		uint32_t rem;
+		uint64_t units = div_u64_rem(pulses, sc->milli_pulses, &rem);
+		if (units > (S64_MAX - 999999) / 1000000) {
+			return S64_MAX;
+		}
+		milli = units * 1000000 + 
+			div_u64((uint64_t)rem * 1000000, sc->milli_pulses);
+	}
+	if (sc->offset_milli > 0 && milli > S64_MAX - sc->offset_milli) {
+		return S64_MAX;
+	}
+	return (int64_t)milli + sc->offset_milli;
+}
+
+/**
+ * Parse "[-]<integer>[.<up to 3 decimals>]" into thousandths
+ */
+static int
+parse_milli(const char *str, int64_t *milli)
+{
+	bool negative = *str == '-';
+	const char *p = negative ? str + 1 : str;
+	uint64_t whole = 0;
+	unsigned int digits = 0;
+	for (; *p >= '0' && *p <= '9'; p++, digits++) {
+		if (whole > (S64_MAX / 1000 - 9) / 10) {
+			return -ERANGE;
+		}
+		whole = whole * 10 + (*p - '0');
+	}
+	int64_t frac = 0;
+	unsigned int places = 0;
+	if (*p == '.') {
+		for (p++; *p >= '0' && *p <= '9'; p++, digits++) {
+			if (places < 3) {
+				frac = frac * 10 + (*p - '0');
+				places++;
+			}
+		}
+	}
+	if (!digits || (*p && *p != '\n')) {
+		return -EINVAL;
+	}
+	for (; places < 3; places++) {
+		frac *= 10;
+	}
+	*milli = (int64_t)(whole * 1000) + frac;
+	if (negative) {
+		*milli = -*milli;
+	}
+	return 0;
+}
+
+/**
+ * Time-of-use tariffs -- every counted press is also added to its input's
+ * register for the active tariff, which is switched by writing 'tariff' 
+ * or at the times of day (UTC) in a daily schedule, by a realtime alarm 
+ * so that the switch lands on the boundary even across suspend. A pulse
+ * only reads the active tariff and bumps its own input's register, with
+ * no lock; switches are serialized by the lock and bump tariff_seq, so a
+ * reader that copies the registers and finds tariff_seq unchanged has
+ * not straddled a switch
+ */
+
+#define MAX_TARIFF_SWITCHES 16
+
+struct tariff_switch {
+	uint32_t second; // of the day
+	uint8_t tariff;
+};
+
+static DEFINE_SPINLOCK(tariff_lock); // serializes writers of tariff_seq
+static seqcount_t tariff_seq = SEQCNT_ZERO(tariff_seq);
+static unsigned int active_tariff = 0;
+
+static void
+tariff_add(struct gpiocount_input *in)
+{
+	if (!GPIOCOUNT_TARIFFS) {
+		return;
+	}
+	in->tariff_counts[READ_ONCE(active_tariff)]++;
+}
+
+#if GPIOCOUNT_TARIFFS
+
+static struct tariff_switch tariff_schedule[MAX_TARIFF_SWITCHES];
+static unsigned int tariff_switches = 0; // entries in tariff_schedule
+static struct alarm tariff_alarm;
+
+static void
+tariff_set(unsigned int tariff)
+{
+	unsigned long flags;
+	spin_lock_irqsave(&tariff_lock, flags);
+	write_seqcount_begin(&tariff_seq);
+	WRITE_ONCE(active_tariff, tariff);
+	write_seqcount_end(&tariff_seq);
+	spin_unlock_irqrestore(&tariff_lock, flags);
+}
+
+/**
+ * Apply the schedule entry in force at the given time and arm the alarm 
+ * for the next one -- the schedule is sorted and repeats daily, so before
+ * the first switch of the day the last one of the day before holds
+ */
+static void
+tariff_schedule_apply(ktime_t now)
+{
+	if (tariff_switches == 0) {
+		return;
+	}
+	uint32_t second;
+	uint64_t day = div_u64_rem(div_u64(ktime_to_ns(now), NSEC_PER_SEC), 
+		86400, &second);
+	unsigned int next = 0;
+	while (next < tariff_switches && tariff_schedule[next].second <= second) {
+		next++;
+	}
+	tariff_set(tariff_schedule[next == 0 ? tariff_switches - 1 : next - 1].tariff);
+	uint64_t next_sec = day * 86400 + (next < tariff_switches ? 
+		tariff_schedule[next].second : 86400 + tariff_schedule[0].second);
+	alarm_start(&tariff_alarm, ns_to_ktime(next_sec * NSEC_PER_SEC));
+}
+
+static enum alarmtimer_restart
+tariff_alarm_fired(struct alarm *alarm, ktime_t now)
+{
+	tariff_schedule_apply(now);
+	return ALARMTIMER_NORESTART;
+}
+
+#endif
+
+/**
+ * Edge-to-LED latency -- time from taking an edge's timestamp in the
+ * handler to set_leds_from_value() completing the resulting LED writes,
+ * in power-of-two nanosecond buckets
+ */
+
+static bool measure_latency = false;
+#if GPIOCOUNT_LATENCY
+module_param(measure_latency, bool, 0644);
+MODULE_PARM_DESC(measure_latency, "Record edge-to-LED latency of button presses");
+#endif
+
+#define LATENCY_BUCKETS 32 // the last one collects everything over ~2s
+
+static struct {
+	uint64_t buckets[LATENCY_BUCKETS];
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t min_ns;
+	uint64_t max_ns;
+} latency ____cacheline_aligned_in_smp; // written per press with measure_latency
+
+static void
+record_latency(uint64_t ns)
+{
+	unsigned int bucket = min(fls64(ns), LATENCY_BUCKETS - 1);
+	latency.buckets[bucket]++;
+	if (latency.count == 0 || ns < latency.min_ns) {
+		latency.min_ns = ns;
+	}
+	if (ns > latency.max_ns) {
+		latency.max_ns = ns;
+	}
+	latency.count++;
+	latency.total_ns += ns;
+}
+
+static struct kobject *gpiocount_kobj = NULL; 
+
+/**
+ * Button gestures -- see gpiocount_gesture.h. A press shorter than the
+ * press window is released once the window is over, which release_timer
+ * catches rather than waiting for the next press. button_lock keeps the
+ * timer and the button's handler from working on its state at once
+ */
+
+enum gesture_action {
+	GESTURE_ACTION_NONE,
+	GESTURE_ACTION_RESET, // set the value to 0
+	GESTURE_ACTIONS,
+};
+
+static struct {
+	unsigned int long_msec;
+	unsigned int double_msec;
+	enum gesture_action long_action;
+	enum gesture_action double_action;
+	struct gc_gesture_tracker tracker;
+	enum gc_gesture last;
+	uint64_t counts[GC_GESTURE_TYPES];
+} gestures = {
+	.long_msec = 1000,
+	.double_msec = 400,
+};
+
+static DEFINE_SPINLOCK(button_lock);
+static struct timer_list release_timer;
+static struct kernfs_node *gesture_dirent = NULL; // for notifying
+
+static void
+gesture_act(enum gesture_action action)
+{
+	if (action == GESTURE_ACTION_RESET) {
+		printk(KERN_INFO "gpiocount: value reset by gesture\n");
+		counter.value = 0;
+		set_leds_from_value();
+	}
+}
+
+static void
+classify_gesture(const struct gc_debounce *d)
+{
+	enum gc_gesture g = gc_gesture_classify(&gestures.tracker, d, 
+		(uint64_t)gestures.long_msec * NSEC_PER_MSEC, 
+		(uint64_t)gestures.double_msec * NSEC_PER_MSEC);
+	gestures.last = g;
+	gestures.counts[g]++;
+	if (g == GC_GESTURE_LONG) {
+		gesture_act(gestures.long_action);
+	} else if (g == GC_GESTURE_DOUBLE) {
+		gesture_act(gestures.double_action);
+	}
+	// the dirent was looked up at init -- sysfs_notify() can sleep
+	if (gesture_dirent) {
+		sysfs_notify_dirent(gesture_dirent);
+	}
+}
+
+/**
+ * Wake up when the press window holding a release is over -- only when a
+ * gesture has an action, which must not wait. Otherwise the release is
+ * settled lazily, by the next edge, a read of 'gesture' or
+ * 'gesture_counts', or a housekeeping run, so a short press arms no timer
+ */
+static void
+arm_release_timer(const struct gc_debounce *d, uint64_t now_ns)
+{
+	if (gestures.long_action == GESTURE_ACTION_NONE && 
+		gestures.double_action == GESTURE_ACTION_NONE) {
+		return;
+	}
+	uint64_t end_ns = d->last_accept_ns + d->window_ns;
+	mod_timer(&release_timer, jiffies + 1 + 
+		nsecs_to_jiffies(end_ns > now_ns ? end_ns - now_ns : 0));
+}
+
+/**
+ * Classify the button's held release if its window is over by now
+ */
+static void
+settle_button(void)
+{
+	if (!GPIOCOUNT_GESTURES) {
+		return;
+	}
+	struct gc_debounce *d = &inputs[0].debounce;
+	uint64_t now_ns = ktime_get_ns();
+	unsigned long flags;
+	spin_lock_irqsave(&button_lock, flags);
+	if (gc_debounce_settle(d, now_ns)) {
+		classify_gesture(d);
+	} else if (d->release_held) {
+		arm_release_timer(d, now_ns); // the window grew meanwhile
+	}
+	spin_unlock_irqrestore(&button_lock, flags);
+}
+
+#if GPIOCOUNT_GESTURES
+
+static void
+release_timer_fired(struct timer_list *t)
+{
+	settle_button();
+}
+
+#endif
+
+/**
+ * Process one edge on an input, whichever handler saw it
+ */
+static void
+input_edge(struct gpiocount_input *in, uint64_t now_ns, uint8_t level)
+{
+	// the button's state is also settled from release_timer
+	bool button = GPIOCOUNT_GESTURES && in->index == 0;
+	unsigned long flags = 0;
+	if (button) {
+		spin_lock_irqsave(&button_lock, flags);
+	}
+	uint64_t t = profile_start();
+	in->level = level;
+	record_event(now_ns, in->index, level);
+	profile_charge(PROFILE_EVENT, &t);
+
+	if (button && gc_debounce_settle(&in->debounce, now_ns)) {
+		// a short press, released in its window before this edge
+		classify_gesture(&in->debounce);
+		profile_charge(PROFILE_NOTIFY, &t);
+	}
+	enum gc_edge_result result = gc_debounce_edge(&in->debounce, now_ns, level);
+	profile_charge(PROFILE_DEBOUNCE, &t);
+	if (result == GC_EDGE_COUNT) {
+		// an input's edges are serialized by its interrupt, so one writer,
+		// but a threaded handler can be preempted or interrupted 
+		// mid-write, which would leave a reader spinning
+		unsigned long seq_flags;
+		local_irq_save(seq_flags);
+		write_seqcount_begin(&in->seq);
+		in->count++;
+		rate_add(&in->rate, now_ns);
+		tariff_add(in);
+		if (in->index == 0) {
+			increment_maybe_wrap();
+		}
+		write_seqcount_end(&in->seq);
+		local_irq_restore(seq_flags);
+		if (in->index == 0 && GPIOCOUNT_VERBOSE) {
+			printk(KERN_INFO "gpiocount: button pressed\n");
+		}
+		profile_charge(PROFILE_COUNT, &t);
+		if (in->index == 0) {
+			// charges its own phases
+			set_leds_from_value();
+			if (GPIOCOUNT_LATENCY && measure_latency) {
+				record_latency(ktime_get_ns() - now_ns);
+			}
+			t = profile_start();
+		}
+	}
+	if (!button) {
+		return;
+	}
+	// with the glitch filter a press is counted on its release
+	if (result == GC_EDGE_RELEASE || 
+		(result == GC_EDGE_COUNT && !in->debounce.pressed)) {
+		classify_gesture(&in->debounce);
+		profile_charge(PROFILE_NOTIFY, &t);
+	} else if (result == GC_EDGE_PENDING && in->debounce.release_held) {
+		arm_release_timer(&in->debounce, now_ns);
+	}
+	spin_unlock_irqrestore(&button_lock, flags);
+}
+
+static irqreturn_t
+button_irq_handler(int irq, void *dev_id)
+{
+	struct gpiocount_input *in = dev_id;
+	uint64_t t = profile_start();
+	uint8_t level = (in->irq_threaded ? 
+		gpio_get_value_cansleep(in->gpio) : gpio_get_value(in->gpio)) ? 1 : 0;
+	if (level == in->level) {
+		return IRQ_NONE;
+	}
+	uint64_t now_ns = ktime_get_ns();
+	profile_charge(PROFILE_TIMESTAMP, &t);
+	input_edge(in, now_ns, level);
+   	return IRQ_HANDLED;
+}
+
+/**
+ * Input bank -- instead of an IRQ per input, the extra inputs can all be
+ * read on one shared interrupt line, typically the INT output of the GPIO
+ * expander they are on. The handler reads every line with a single array
+ * read, diffs it against the previous snapshot and processes only the
+ * inputs that changed, so a burst costs one bus transaction, not one per 
+ * input
+ */
+
+static unsigned int input_bank_gpio = 0; // 0 for an IRQ per input
+
+static struct {
+	bool assigned;
+	unsigned int irq;
+	unsigned int lines;
+	struct gpio_desc **descs; // the extra inputs, in order
+	unsigned long *snapshot; // line levels as of the last read
+	unsigned long *levels; // scratch for the next read
+} input_bank;
+
+static irqreturn_t
+input_bank_handler(int irq, void *dev_id)
+{
+	uint64_t t = profile_start();
+	if (gpiod_get_array_value_cansleep(input_bank.lines, input_bank.descs, 
+		NULL, input_bank.levels)) {
+		return IRQ_NONE;
+	}
+	uint64_t now_ns = ktime_get_ns();
+	profile_charge(PROFILE_TIMESTAMP, &t);
+	bool changed = false;
+	for (unsigned int w = 0; w < BITS_TO_LONGS(input_bank.lines); w++) {
+		unsigned long diff = input_bank.levels[w] ^ input_bank.snapshot[w];
+		while (diff) {
+			unsigned int bit = __ffs(diff);
+			diff &= diff - 1;
+			unsigned int line = w * BITS_PER_LONG + bit;
+			input_edge(&inputs[1 + line], now_ns, 
+				(input_bank.levels[w] >> bit) & 1);
+			changed = true;
+		}
+		input_bank.snapshot[w] = input_bank.levels[w];
+	}
+	return changed ? IRQ_HANDLED : IRQ_NONE;
+}
+
+static void
+unassign_input_bank(void)
+{
+	if (input_bank.assigned) {
+		printk(KERN_INFO "gpiocount: releasing input bank on IRQ %u\n", 
+			input_bank.irq);
+		free_irq(input_bank.irq, &input_bank);
+		input_bank.assigned = false;
+	}
+	kfree(input_bank.descs);
+	bitmap_free(input_bank.snapshot);
+	bitmap_free(input_bank.levels);
+	input_bank.descs = NULL;
+	input_bank.snapshot = NULL;
+	input_bank.levels = NULL;
+	input_bank.lines = 0;
+}
+
+/**
+ * Set up the bank over the currently configured extra inputs
+ */
+static int
+assign_input_bank(void)
+{
+	if (!enable_gpio || input_count <= 1) {
+		return 0;
+	}
+	if (!gpio_is_valid(input_bank_gpio)) {
+		printk(KERN_INFO "gpiocount: invalid input bank GPIO %u\n", 
+			input_bank_gpio);
+		return -EINVAL;
+	}
+	input_bank.lines = input_count - 1;
+	input_bank.descs = kcalloc(input_bank.lines, sizeof(*input_bank.descs), 
+		GFP_KERNEL);
+	input_bank.snapshot = bitmap_zalloc(input_bank.lines, GFP_KERNEL);
+	input_bank.levels = bitmap_zalloc(input_bank.lines, GFP_KERNEL);
+	if (!input_bank.descs || !input_bank.snapshot || !input_bank.levels) {
+		unassign_input_bank();
+		return -ENOMEM;
+	}
+	for (unsigned int i = 0; i < input_bank.lines; i++) {
+		input_bank.descs[i] = gpio_to_desc(inputs[1 + i].gpio);
+		if (!input_bank.descs[i]) {
+			printk(KERN_INFO "gpiocount: no descriptor for input GPIO %u\n", 
+				inputs[1 + i].gpio);
+			unassign_input_bank();
+			return -EINVAL;
+		}
+	}
+	int result = gpiod_get_array_value_cansleep(input_bank.lines, 
+		input_bank.descs, NULL, input_bank.snapshot);
+	if (result) {
+		unassign_input_bank();
+		return result;
+	}
+	for (unsigned int i = 0; i < input_bank.lines; i++) {
+		inputs[1 + i].level = test_bit(i, input_bank.snapshot) ? 1 : 0;
+	}
+
+	gpio_direction_input(input_bank_gpio);
+	input_bank.irq = gpio_to_irq(input_bank_gpio);
+	// level, not edge -- an open-drain INT that is still low because a
+	// change latched during the read would never produce another edge.
+	// ONESHOT keeps the line masked until the read has cleared it
+	printk(KERN_INFO "gpiocount: input bank of %u lines on IRQ %u\n", 
+		input_bank.lines, input_bank.irq);
+	result = request_threaded_irq(input_bank.irq, NULL, input_bank_handler,
+		IRQF_TRIGGER_LOW | IRQF_ONESHOT | IRQF_SHARED, 
+		"gpiocount_bank", &input_bank);
+	if (result) {
+		printk(KERN_INFO "gpiocount: The interrupt request result is: %d\n", result);   
+		unassign_input_bank();
+		return result;
+	}
+	input_bank.assigned = true;
+	return 0;
+}
+
+/** 
+ * Set up an input's GPIO and request its IRQ -- all inputs use the same
+ * flags so that any of them can share a line, and inputs behind a 
+ * sleeping bus (e.g. an I2C expander) get a threaded handler
+ * Invariant: the input is not currently set up
+ */
+static int 
+assign_input(struct gpiocount_input *in)
+{
+	if (enable_gpio) {
+
+		if (!gpio_is_valid(in->gpio)) {
+			printk(KERN_INFO "gpiocount: invalid input GPIO %u\n", in->gpio);
+			return -EINVAL;
+		}
+		gpio_direction_input(in->gpio);
+		// TODO: seems like this made it worse!
+		int result = gpio_set_debounce(in->gpio, 200);
+		if (result) {
+			printk(KERN_INFO "gpiocount: attempt to debounce returned %d\n", result); 
+		} else {
+			printk(KERN_INFO "gpiocount: debounce ok\n"); 
+		}
+
+		in->irq = gpio_to_irq(in->gpio);
+		in->irq_threaded = gpio_cansleep(in->gpio);
+		in->level = (in->irq_threaded ? 
+			gpio_get_value_cansleep(in->gpio) : gpio_get_value(in->gpio)) ? 1 : 0;
+   		printk(KERN_INFO "gpiocount: input %u on GPIO %u is mapped to IRQ: %u\n", 
+			in->index, in->gpio, in->irq);
+
+		unsigned long flags = 
+			IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING | IRQF_SHARED;
+		if (in->irq_threaded) {
+			result = request_threaded_irq(in->irq, NULL, button_irq_handler,
+				flags | IRQF_ONESHOT, "gpiocount_handler", in);
+		} else {
+			result = request_irq(in->irq, button_irq_handler,
+				flags, "gpiocount_handler", in);
+		}
+
+		if (result) {
+			printk(KERN_INFO "gpiocount: The interrupt request result is: %d\n", result);   
+			return result;
+		}
+		in->assigned = true;
+	}
+	
+	return 0;
+}
+
+static int
+unassign_input(struct gpiocount_input *in) 
+{
+	if (in->assigned) {
+		printk(KERN_INFO "gpiocount: releasing input %u on GPIO %u\n", 
+			in->index, in->gpio);
+		free_irq(in->irq, in);
+		gpio_unexport(in->gpio);
+		gpio_free(in->gpio);
+		in->assigned = false;
+	}
+	return 0;
+}
+
+static int
+assign_increment_button(void)
+{
+	return assign_input(&inputs[0]);
+}
+
+static int
+unassign_increment_button(void) 
+{
+	return unassign_input(&inputs[0]);
+}
+
+/**
+ * Unassign the extra counter inputs
+ */
+static void
+unassign_extra_inputs(void)
+{
+	unassign_input_bank();
+	for (unsigned int i = 1; i < input_count; i++) {
+		unassign_input(&inputs[i]);
+	}
+	input_count = 1;
+}
+
+/**
+ * Parse a comma-separated GPIO list and set up an extra input for each
+ * -- must be called with no extra inputs assigned
+ */
+static int
+assign_extra_inputs(const char *desc)
+{
+	char *list = kstrdup(desc, GFP_KERNEL);
+	if (!list) {
+		return -ENOMEM;
+	}
+	char *cursor = strim(list);
+	char *token;
+	int result = 0;
+	bool full = false;
+	while (!result && !full && (token = strsep(&cursor, ",")) != NULL) {
+		// a GPIO or a range "<first>-<last>", as on an expander
+		unsigned int first, last;
+		char *dash = strchr(token, '-');
+		if (dash) {
+			*dash++ = '\0';
+		}
+		if (kstrtouint(token, 10, &first) || 
+			kstrtouint(dash ? dash : token, 10, &last) || last < first) {
+			printk(KERN_INFO "gpiocount: bad input GPIO '%s'\n", token);
+			result = -EINVAL;
+			break;
+		}
+		for (unsigned int gpio = first; gpio <= last; gpio++) {
+			if (input_count >= max_inputs) {
+				printk(KERN_INFO "gpiocount: too many input GPIOs -- skipping rest\n");
+				full = true;
+				break;
+			}
+			struct gpiocount_input *in = &inputs[input_count];
+			in->gpio = gpio;
+			in->count = 0;
+			memset(&in->rate, 0, sizeof(in->rate));
+			memset(in->tariff_counts, 0, sizeof(in->tariff_counts));
+			copy_debounce_settings(in);
+			if (input_bank_gpio == 0) {
+				result = assign_input(in);
+				if (result) {
+					break;
+				}
+			} else if (enable_gpio) {
+				if (!gpio_is_valid(gpio)) {
+					printk(KERN_INFO "gpiocount: invalid input GPIO %u\n", gpio);
+					result = -EINVAL;
+					break;
+				}
+				gpio_direction_input(gpio);
+			}
+			input_count++;
+		}
+	}
+	kfree(list);
+	if (!result && input_bank_gpio != 0) {
+		result = assign_input_bank();
+	}
+	if (result) {
+		unassign_extra_inputs();
+	}
+	return result;
+}
+
+/**
+ * Unassign all dyanmically defined buttons
+ */
+static int
+unassign_buttons(void) 
+{
+	unassign_extra_inputs();
+	int result = unassign_increment_button();
+	if (result) return result;
+	return 0;
+}
+
+/**
+ * Stall detection -- each pulse already leaves its timestamp in the
+ * input's debounce state, so a single scan from the housekeeping timer
+ * finds every input that has been quiet for stall_sec at once, instead
+ * of a timer per input being re-armed on every pulse. Inputs that have
+ * never pulsed are not considered
+ */
+
+static unsigned int stall_sec __read_mostly = 0; // 0 for no stall detection
+static unsigned int stalled_count = 0;
+static uint64_t stall_events = 0;
+static uint64_t last_scan_ns = 0; // duration of the latest scan
+static unsigned int last_scan_inputs = 0; // inputs it covered
+static struct kernfs_node *stalled_inputs_dirent = NULL; // for notifying
+
+/**
+ * Update the stalled set, notifying pollers of 'stalled_inputs' if it
+ * changed
+ * @return nanoseconds until the next input could stall
+ */
+static uint64_t
+scan_stalls(uint64_t now_ns)
+{
+	uint64_t limit_ns = (uint64_t)stall_sec * NSEC_PER_SEC;
+	uint64_t next_ns = limit_ns;
+	bool changed = false;
+	for (unsigned int i = 0; i < input_count; i++) {
+		const struct gc_debounce *d = &inputs[i].debounce;
+		if (!d->primed) {
+			continue;
+		}
+		uint64_t quiet_ns = now_ns - d->last_accept_ns;
+		if (quiet_ns >= limit_ns) {
+			if (!test_and_set_bit(i, stalled_inputs)) {
+				stalled_count++;
+				stall_events++;
+				changed = true;
+			}
+		} else {
+			if (test_and_clear_bit(i, stalled_inputs)) {
+				stalled_count--;
+				changed = true;
+			}
+			next_ns = min(next_ns, limit_ns - quiet_ns);
+		}
+	}
+	// the dirent was looked up at init -- sysfs_notify() can sleep
+	if (changed && stalled_inputs_dirent) {
+		sysfs_notify_dirent(stalled_inputs_dirent);
+	}
+	return next_ns;
+}
+
+static void
+clear_stalls(void)
+{
+	bitmap_zero(stalled_inputs, max_inputs);
+	stalled_count = 0;
+}
+
+/**
+ * Housekeeping -- all periodic work shares one deferrable timer, so it
+ * never wakes an idle CPU just for us and is only armed while some job
+ * is enabled. Each run works out from timestamps what is due, so a late
+ * expiry simply catches up, then sleeps until the earliest next deadline
+ */
+
+static unsigned int stats_decay_sec __read_mostly = 0; // 0 keeps statistics forever
+static unsigned long last_decay_jiffies = 0;
+static uint64_t housekeeping_runs = 0;
+
+static void
+blank_leds(void)
+{
+	unsigned long flags;
+	spin_lock_irqsave(&led_lock, flags);
+	if (leds_live) {
+		write_leds(true);
+	}
+	counter.leds_blanked = true;
+	spin_unlock_irqrestore(&led_lock, flags);
+}
+
+/**
+ * Halve the latency histogram once per elapsed decay period, so it
+ * favours recent behaviour
+ */
+static void
+decay_stats(unsigned int periods)
+{
+	if (!GPIOCOUNT_LATENCY) {
+		return;
+	}
+	unsigned int shift = min(periods, 63u);
+	latency.count = 0;
+	for (unsigned int i = 0; i < LATENCY_BUCKETS; i++) {
+		latency.buckets[i] >>= shift;
+		latency.count += latency.buckets[i];
+	}
+	latency.total_ns >>= shift;
+}
+
+/**
+ * Set the bar groups from the button's current pulse rate, writing the
+ * LEDs only if a bar has changed
+ */
+static void
+refresh_bars(uint64_t now_ns)
+{
+	uint64_t millihz = rate_millihz(&inputs[0].rate, now_ns);
+	bool changed = false;
+	unsigned long flags;
+	spin_lock_irqsave(&led_lock, flags);
+	if (!leds_live) {
+		spin_unlock_irqrestore(&led_lock, flags);
+		return;
+	}
+	for (unsigned int g = 0; g < display_group_count; g++) {
+		struct display_group *group = &display_groups[g];
+		if (!display_is_bar(group)) {
+			continue;
+		}
+		uint8_t lit = 0;
+		while (lit < group->count && millihz >= group->thresholds[lit]) {
+			lit++;
+		}
+		if (lit == group->lit) {
+			continue;
+		}
+		group->lit = lit;
+		for (unsigned int i = 0; i < group->count; i++) {
+			led_values[group->first + i].on = i < lit;
+		}
+		changed = true;
+	}
+	if (changed) {
+		write_leds(false);
+	}
+	spin_unlock_irqrestore(&led_lock, flags);
+}
+
+static bool
+display_has_bars(void)
+{
+	for (unsigned int g = 0; g < display_group_count; g++) {
+		if (display_is_bar(&display_groups[g])) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool
+housekeeping_needed(void)
+{
+	return (idle_blank_sec && led_count > 0) || stats_decay_sec || stall_sec ||
+		display_has_bars();
+}
+
+static void
+housekeeping(struct timer_list *t)
+{
+	unsigned long now = jiffies;
+	unsigned long next = now + MAX_JIFFY_OFFSET / 2;
+	housekeeping_runs++;
+
+	if (idle_blank_sec && led_count > 0 && !counter.leds_blanked) {
+		unsigned long due = counter.last_display_jiffies + idle_blank_sec * HZ;
+		if (time_after_eq(now, due)) {
+			blank_leds();
+		} else if (time_before(due, next)) {
+			next = due;
+		}
+	}
+
+	if (!counter.leds_blanked && display_has_bars()) {
+		// the rate buckets are about a second, so refresh no faster
+		refresh_bars(ktime_get_ns());
+		if (time_before(now + HZ, next)) {
+			next = now + HZ;
+		}
+	}
+
+	if (stats_decay_sec) {
+		unsigned long period = stats_decay_sec * HZ;
+		unsigned int periods = (now - last_decay_jiffies) / period;
+		if (periods > 0) {
+			decay_stats(periods);
+			last_decay_jiffies += periods * period;
+		}
+		if (time_before(last_decay_jiffies + period, next)) {
+			next = last_decay_jiffies + period;
+		}
+	}
+
+	// without a gesture action nothing else settles a held release
+	settle_button();
+
+	if (stall_sec) {
+		// rescan at least every stall_sec to notice recoveries
+		uint64_t start_ns = ktime_get_ns();
+		unsigned long due = now + nsecs_to_jiffies(scan_stalls(start_ns)) + 1;
+		last_scan_ns = ktime_get_ns() - start_ns;
+		last_scan_inputs = input_count;
+		if (time_before(due, next)) {
+			next = due;
+		}
+	}
+
+	if (time_before(next, now + MAX_JIFFY_OFFSET / 2)) {
+		// round to a whole second so we batch with other timers
+		mod_timer(&housekeeping_timer, round_jiffies(next));
+	}
+}
+
+/**
+ * Arm the timer (if any job needs it) after a configuration change
+ */
+static void
+housekeeping_kick(void)
+{
+	last_decay_jiffies = jiffies;
+	if (housekeeping_needed()) {
+		mod_timer(&housekeeping_timer, round_jiffies(jiffies + HZ));
+	}
+}
+
+/**
+ * Set up sysfs integration
+ */
+
+static ssize_t value_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+   	return sprintf(buf, "%llu\n", (unsigned long long)counter.value);
+}
+
+static ssize_t value_store(struct kobject *kobj, 
+	struct kobj_attribute *attr,
+    const char *buf, size_t count)
+{
+	unsigned long long t;
+   	sscanf(buf, "%llu", &t);
+	counter.value = t;
+	printk(KERN_INFO "gpiocount: 'value' set to %llu via sysfs\n", t);
+	set_leds_from_value();
+   	return count;
+}
+
+static ssize_t max_value_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+   	return sprintf(buf, "%llu\n", (unsigned long long)counter.max_value);
+}
+
+static ssize_t max_value_store(struct kobject *kobj, 
+	struct kobj_attribute *attr,
+    const char *buf, size_t count)
+{
+	unsigned long long t;
+   	sscanf(buf, "%llu", &t);
+	counter.max_value = t;
+	printk(KERN_INFO "gpiocount: 'max_value' set to %llu via sysfs\n", t);
+   	return count;
+}
+
+static ssize_t gpio_leds_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+	int length = 0;
+	unsigned long flags;
+	spin_lock_irqsave(&led_lock, flags);
+	for (unsigned int g = 0; leds_live && g < display_group_count; g++) {
+		const struct display_group *group = &display_groups[g];
+		if (g != 0) {
+			length += sprintf(buf + length, ";");
+		}
+		for (int i = group->first; i < group->first + group->count; i++) {
+			if (i != group->first) {
+				length += sprintf(buf + length, ",");
+			}
+			length += sprintf(buf + length, "%u", led_values[i].gpio);
+		}
+		if (display_is_bar(group)) {
+			length += sprintf(buf + length, "::%s:%u", 
+				display_encoding_names[group->encoding], group->full_hz);
+		} else if (group->offset || group->encoding != DISPLAY_BINARY) {
+			length += sprintf(buf + length, ":%u:%s", group->offset, 
+				display_encoding_names[group->encoding]);
+		}
+	}
+	spin_unlock_irqrestore(&led_lock, flags);
+	length += sprintf(buf + length, "\n");
+   	return length;
+}
+
+static ssize_t gpio_leds_store(struct kobject *kobj, 
+	struct kobj_attribute *attr,
+    const char *buf, size_t count)
+{
+	printk(KERN_INFO "gpiocount: reloading LED GPIOs\n");
+	mutex_lock(&config_mutex);
+	unassign_leds();
+	int result = assign_leds(buf);
+	mutex_unlock(&config_mutex);
+	if (result) {
+		return result;
+	}
+	set_leds_from_value();
+	housekeeping_kick();
+   	return count;
+}
+
+static ssize_t display_encoding_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+	int length = 0;
+	for (unsigned int g = 0; g < display_group_count; g++) {
+		const struct display_group *group = &display_groups[g];
+		length += sprintf(buf + length, "%u %s", g, 
+			display_encoding_names[group->encoding]);
+		if (display_is_bar(group)) {
+			length += sprintf(buf + length, " %u", group->full_hz);
+		}
+		length += sprintf(buf + length, "\n");
+	}
+   	return length;
+}
+
+/**
+ * Switch a group's encoding, with led_lock held
+ */
+static void
+set_display_encoding(struct display_group *group, 
+	enum display_encoding encoding, uint32_t full_hz)
+{
+	group->encoding = encoding;
+	group->full_hz = full_hz;
+	if (display_is_bar(group)) {
+		group->offset = 0;
+		setup_bar_thresholds(group);
+		for (unsigned int i = 0; i < group->count; i++) {
+			led_values[group->first + i].on = false;
+		}
+		write_leds(false);
+	}
+}
+
+/**
+ * Accepts "<group> <encoding> [<full scale Hz>]"
+ */
+static ssize_t display_encoding_store(struct kobject *kobj, 
+	struct kobj_attribute *attr,
+    const char *buf, size_t count)
+{
+	unsigned int g, full_hz = DISPLAY_BAR_DEFAULT_HZ;
+	char name[16];
+   	if (sscanf(buf, "%u %15s %u", &g, name, &full_hz) < 2 || 
+		g >= display_group_count || !full_hz) {
+		return -EINVAL;
+	}
+	int encoding = parse_display_encoding(name);
+	if (encoding < 0) {
+		return -EINVAL;
+	}
+	mutex_lock(&config_mutex);
+	unsigned long flags;
+	spin_lock_irqsave(&led_lock, flags); // not in the middle of a press
+	if (!leds_live || g >= display_group_count) {
+		spin_unlock_irqrestore(&led_lock, flags);
+		mutex_unlock(&config_mutex);
+		return -EINVAL;
+	}
+	set_display_encoding(&display_groups[g], encoding, full_hz);
+	setup_max_possible();
+	spin_unlock_irqrestore(&led_lock, flags);
+	mutex_unlock(&config_mutex);
+	set_leds_from_value();
+	housekeeping_kick();
+   	return count;
+}
+
+static ssize_t increment_store(struct kobject *kobj, 
+	struct kobj_attribute *attr,
+    const char *buf, size_t count)
+{
+	printk(KERN_INFO "gpiocount: incrementing counter\n");
+	increment_maybe_wrap();
 	set_leds_from_value();
    	return count;
 }
 
-static ssize_t increment_store(struct kobject *kobj, 
+static ssize_t gpio_button_increment_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+   	return sprintf(buf, "%u\n", inputs[0].gpio);
+}
+
+static ssize_t gpio_button_increment_store(struct kobject *kobj, 
+	struct kobj_attribute *attr,
+    const char *buf, size_t count)
+{
+	uint32_t t;
+   	sscanf(buf, "%u", &t);
+	mutex_lock(&config_mutex);
+	unassign_increment_button(); // in case we already have one
+	// don't assign until after we've disabled the previous one
+	inputs[0].gpio = t;
+	assign_increment_button();
+	mutex_unlock(&config_mutex);
+   	return count;
+}
+
+static ssize_t gpio_inputs_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+	int length = 0;
+	for (unsigned int i = 1; i < input_count; i++) {
+		length += scnprintf(buf + length, PAGE_SIZE - length, 
+			i == 1 ? "%u" : ",%u", inputs[i].gpio);
+	}
+	length += scnprintf(buf + length, PAGE_SIZE - length, "\n");
+   	return length;
+}
+
+static ssize_t gpio_inputs_store(struct kobject *kobj, 
+	struct kobj_attribute *attr,
+    const char *buf, size_t count)
+{
+	printk(KERN_INFO "gpiocount: reloading input GPIOs\n");
+	mutex_lock(&config_mutex);
+	unassign_extra_inputs();
+	clear_stalls();
+	int result = assign_extra_inputs(buf);
+	mutex_unlock(&config_mutex);
+   	return result ? result : count;
+}
+
+static ssize_t
+input_rates_render(char *buf, size_t size)
+{
+	uint64_t now_ns = ktime_get_ns();
+	size_t length = 0;
+	for (unsigned int i = 0; i < input_count; i++) {
+		uint32_t rem;
+		uint64_t hz = div_u64_rem(rate_millihz(&inputs[i].rate, now_ns), 
+			1000, &rem);
+		length += scnprintf(buf + length, size - length, 
+			i == 0 ? "%llu.%03u" : ",%llu.%03u", (unsigned long long)hz, rem);
+	}
+	length += scnprintf(buf + length, size - length, "\n");
+   	return length;
+}
+
+static int
+print_milli(char *buf, int size, const char *sep, int64_t milli)
+{
+	uint64_t magnitude = milli < 0 ? -(uint64_t)milli : milli;
+	uint32_t rem;
+	uint64_t whole = div_u64_rem(magnitude, 1000, &rem);
+	return scnprintf(buf, size, "%s%s%llu.%03u", sep, milli < 0 ? "-" : "",
+		(unsigned long long)whole, rem);
+}
+
+static ssize_t
+input_totals_render(char *buf, size_t size)
+{
+	size_t length = 0;
+	for (unsigned int i = 0; i < input_count; i++) {
+		length += print_milli(buf + length, size - length, 
+			i == 0 ? "" : ",", scale_milli(&inputs[i].scale, inputs[i].count));
+	}
+	length += scnprintf(buf + length, size - length, "\n");
+   	return length;
+}
+
+/**
+ * "<input> <pulses per unit> <offset>" for every input
+ */
+static ssize_t
+input_scale_render(char *buf, size_t size)
+{
+	size_t length = 0;
+	for (unsigned int i = 0; i < input_count; i++) {
+		const struct gpiocount_scale *sc = &inputs[i].scale;
+		length += scnprintf(buf + length, size - length, "%u", i);
+		length += print_milli(buf + length, size - length, " ", 
+			sc->milli_pulses ? sc->milli_pulses : 1000);
+		length += print_milli(buf + length, size - length, " ", 
+			sc->offset_milli);
+		length += scnprintf(buf + length, size - length, "\n");
+	}
+   	return length;
+}
+
+/**
+ * Accepts "<input> <pulses per unit> [<offset>]", decimals allowed
+ */
+static ssize_t
+input_scale_parse(const char *buf, size_t count)
+{
+	char ppu[24], offset[24] = "0";
+	unsigned int index;
+	int64_t milli_pulses, offset_milli;
+   	if (sscanf(buf, "%u %23s %23s", &index, ppu, offset) < 2 || 
+		index >= input_count) {
+		return -EINVAL;
+	}
+	if (parse_milli(ppu, &milli_pulses) || milli_pulses <= 0 || 
+		milli_pulses > U32_MAX || parse_milli(offset, &offset_milli)) {
+		return -EINVAL;
+	}
+	inputs[index].scale.milli_pulses = (uint32_t)milli_pulses;
+	inputs[index].scale.offset_milli = offset_milli;
+   	return count;
+}
+
+#if GPIOCOUNT_TARIFFS
+
+static ssize_t tariff_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+   	return sprintf(buf, "%u\n", active_tariff);
+}
+
+static ssize_t tariff_store(struct kobject *kobj, 
+	struct kobj_attribute *attr,
+    const char *buf, size_t count)
+{
+	unsigned int tariff;
+   	if (sscanf(buf, "%u", &tariff) != 1 || tariff >= MAX_TARIFFS) {
+		return -EINVAL;
+	}
+	tariff_set(tariff);
+   	return count;
+}
+
+static ssize_t tariff_schedule_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+	int length = 0;
+	for (unsigned int i = 0; i < tariff_switches; i++) {
+		length += scnprintf(buf + length, PAGE_SIZE - length, 
+			i == 0 ? "%02u:%02u=%u" : ",%02u:%02u=%u", 
+			tariff_schedule[i].second / 3600, 
+			tariff_schedule[i].second / 60 % 60, tariff_schedule[i].tariff);
+	}
+	length += scnprintf(buf + length, PAGE_SIZE - length, "\n");
+   	return length;
+}
+
+/**
+ * Accepts a comma-separated list of "HH:MM=<tariff>" switches in UTC, or
+ * an empty line to remove the schedule
+ */
+static ssize_t tariff_schedule_store(struct kobject *kobj, 
+	struct kobj_attribute *attr,
+    const char *buf, size_t count)
+{
+	struct tariff_switch schedule[MAX_TARIFF_SWITCHES];
+	unsigned int switches = 0;
+	char *list = kstrdup(buf, GFP_KERNEL);
+	if (!list) {
+		return -ENOMEM;
+	}
+	char *cursor = strim(list);
+	char *token;
+	int result = 0;
+	while (*cursor && (token = strsep(&cursor, ",")) != NULL) {
+		unsigned int hour, minute, tariff;
+		if (sscanf(token, "%u:%u=%u", &hour, &minute, &tariff) != 3 || 
+			hour > 23 || minute > 59 || tariff >= MAX_TARIFFS || 
+			switches == MAX_TARIFF_SWITCHES) {
+			printk(KERN_INFO "gpiocount: bad tariff switch '%s'\n", token);
+			result = -EINVAL;
+			break;
+		}
+		// insertion sort by time of day
+		unsigned int i = switches++;
+		for (; i > 0 && schedule[i - 1].second > hour * 3600 + minute * 60; i--) {
+			schedule[i] = schedule[i - 1];
+		}
+		schedule[i].second = hour * 3600 + minute * 60;
+		schedule[i].tariff = tariff;
+		if (!cursor) {
+			break;
+		}
+	}
+	kfree(list);
+	if (result) {
+		return result;
+	}
+	mutex_lock(&config_mutex);
+	alarm_cancel(&tariff_alarm);
+	memcpy(tariff_schedule, schedule, sizeof(schedule));
+	tariff_switches = switches;
+	tariff_schedule_apply(ktime_get_real());
+	mutex_unlock(&config_mutex);
+   	return count;
+}
+
+/**
+ * One line per input -- "<input> <count for tariff 0> ..."
+ */
+static ssize_t
+tariff_counts_render(char *buf, size_t size)
+{
+	// copy first, again if a tariff switch came in between
+	uint64_t *counts = vmalloc(array_size(input_count, 
+		sizeof(inputs[0].tariff_counts)));
+	if (!counts) {
+		return -ENOMEM;
+	}
+	unsigned int seq;
+	do {
+		seq = read_seqcount_begin(&tariff_seq);
+		for (unsigned int i = 0; i < input_count; i++) {
+			memcpy(counts + i * MAX_TARIFFS, inputs[i].tariff_counts, 
+				sizeof(inputs[i].tariff_counts));
+		}
+	} while (read_seqcount_retry(&tariff_seq, seq));
+	size_t length = 0;
+	for (unsigned int i = 0; i < input_count; i++) {
+		length += scnprintf(buf + length, size - length, "%u", i);
+		for (unsigned int t = 0; t < MAX_TARIFFS; t++) {
+			length += scnprintf(buf + length, size - length, " %llu", 
+				(unsigned long long)counts[i * MAX_TARIFFS + t]);
+		}
+		length += scnprintf(buf + length, size - length, "\n");
+	}
+	vfree(counts);
+   	return length;
+}
+
+#endif
+
+static ssize_t stall_sec_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+   	return sprintf(buf, "%u\n", stall_sec);
+}
+
+static ssize_t stall_sec_store(struct kobject *kobj, 
+	struct kobj_attribute *attr,
+    const char *buf, size_t count)
+{
+   	if (sscanf(buf, "%u", &stall_sec) != 1) {
+		return -EINVAL;
+	}
+	clear_stalls();
+	housekeeping_kick();
+   	return count;
+}
+
+/**
+ * Comma-separated indices of the stalled inputs -- pollable
+ */
+static ssize_t
+stalled_inputs_render(char *buf, size_t size)
+{
+	size_t length = 0;
+	unsigned int i;
+	for_each_set_bit(i, stalled_inputs, input_count) {
+		length += scnprintf(buf + length, size - length, 
+			length == 0 ? "%u" : ",%u", i);
+	}
+	length += scnprintf(buf + length, size - length, "\n");
+   	return length;
+}
+
+static ssize_t stall_events_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+   	return sprintf(buf, "%llu\n", (unsigned long long)stall_events);
+}
+
+static ssize_t stall_scan_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+   	return sprintf(buf, "inputs %u ns %llu\n", last_scan_inputs, 
+		(unsigned long long)last_scan_ns);
+}
+
+static ssize_t gpio_input_bank_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+   	return sprintf(buf, "%u\n", input_bank_gpio);
+}
+
+static ssize_t gpio_input_bank_store(struct kobject *kobj, 
+	struct kobj_attribute *attr,
+    const char *buf, size_t count)
+{
+	uint32_t t;
+   	if (sscanf(buf, "%u", &t) != 1 || 
+		(enable_gpio && t != 0 && !gpio_is_valid(t))) {
+		return -EINVAL;
+	}
+	// the extra inputs have to be reassigned in the new mode
+	mutex_lock(&config_mutex);
+	unassign_extra_inputs();
+	input_bank_gpio = t;
+	mutex_unlock(&config_mutex);
+	printk(KERN_INFO "gpiocount: 'gpio_input_bank' set to %u via sysfs\n", t);
+   	return count;
+}
+
+static ssize_t
+input_counts_render(char *buf, size_t size)
+{
+	size_t length = 0;
+	for (unsigned int i = 0; i < input_count; i++) {
+		length += scnprintf(buf + length, size - length, 
+			i == 0 ? "%llu" : ",%llu", (unsigned long long)inputs[i].count);
+	}
+	length += scnprintf(buf + length, size - length, "\n");
+   	return length;
+}
+
+static ssize_t sim_writes_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+   	return sprintf(buf, "%llu\n", (unsigned long long)sim_writes);
+}
+
+/**
+ * The newest simulated writes that fit in a page, oldest first
+ */
+/**
+ * The trace oldest write first, as "<ts_ns> <gpio> <value>" lines
+ */
+static ssize_t
+sim_trace_render(char *buf, size_t size)
+{
+	if (!sim_trace) {
+		return 0;
+	}
+	// copy first, so the lock is not held while formatting
+	struct sim_write *writes = vmalloc(array_size(sim_trace_len, 
+		sizeof(*writes)));
+	if (!writes) {
+		return -ENOMEM;
+	}
+	unsigned long flags;
+	spin_lock_irqsave(&sim_lock, flags);
+	unsigned int n = sim_trace_filled;
+	unsigned int i = (sim_trace_head + sim_trace_len - n) % sim_trace_len;
+	for (unsigned int j = 0; j < n; j++) {
+		writes[j] = sim_trace[i];
+		if (++i == sim_trace_len) {
+			i = 0;
+		}
+	}
+	spin_unlock_irqrestore(&sim_lock, flags);
+	size_t length = 0;
+	for (unsigned int j = 0; j < n; j++) {
+		length += scnprintf(buf + length, size - length, "%llu %u %u\n",
+			(unsigned long long)writes[j].ts_ns, writes[j].gpio, 
+			writes[j].value);
+	}
+	vfree(writes);
+	return length;
+}
+
+/**
+ * Any write clears the trace
+ */
+static ssize_t
+sim_trace_parse(const char *buf, size_t count)
+{
+	unsigned long flags;
+	spin_lock_irqsave(&sim_lock, flags);
+	sim_trace_head = 0;
+	sim_trace_filled = 0;
+	sim_writes = 0;
+	spin_unlock_irqrestore(&sim_lock, flags);
+   	return count;
+}
+
+/**
+ * Inject an edge as "<input> <level>" -- only with simulated GPIO
+ */
+static ssize_t sim_edge_store(struct kobject *kobj, 
+	struct kobj_attribute *attr,
+    const char *buf, size_t count)
+{
+	uint32_t index, level;
+	if (enable_gpio || !sim_gpio) {
+		return -EPERM;
+	}
+   	if (sscanf(buf, "%u %u", &index, &level) != 2 || index >= input_count) {
+		return -EINVAL;
+	}
+	struct gpiocount_input *in = &inputs[index];
+	if ((level ? 1 : 0) != in->level) {
+		unsigned long flags;
+		local_irq_save(flags); // as if from the handler
+		input_edge(in, ktime_get_ns(), level ? 1 : 0);
+		local_irq_restore(flags);
+	}
+   	return count;
+}
+
+#if GPIOCOUNT_LATENCY
+
+/**
+ * Summary line, then "<bucket upper bound ns> <count>" for non-empty buckets
+ */
+static ssize_t latency_hist_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+	int length = scnprintf(buf, PAGE_SIZE, 
+		"count %llu min_ns %llu mean_ns %llu max_ns %llu\n",
+		(unsigned long long)latency.count, 
+		(unsigned long long)latency.min_ns,
+		(unsigned long long)(latency.count ? 
+			div64_u64(latency.total_ns, latency.count) : 0),
+		(unsigned long long)latency.max_ns);
+	for (unsigned int i = 0; i < LATENCY_BUCKETS; i++) {
+		if (latency.buckets[i]) {
+			length += scnprintf(buf + length, PAGE_SIZE - length, 
+				"%llu %llu\n", i == LATENCY_BUCKETS - 1 ? 
+					(unsigned long long)U64_MAX : (1ull << i) - 1,
+				(unsigned long long)latency.buckets[i]);
+		}
+	}
+   	return length;
+}
+
+static ssize_t latency_hist_store(struct kobject *kobj, 
+	struct kobj_attribute *attr,
+    const char *buf, size_t count)
+{
+	memset(&latency, 0, sizeof(latency));
+	printk(KERN_INFO "gpiocount: latency histogram cleared\n");
+   	return count;
+}
+
+#endif
+
+static ssize_t idle_blank_sec_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+   	return sprintf(buf, "%u\n", idle_blank_sec);
+}
+
+static ssize_t idle_blank_sec_store(struct kobject *kobj, 
+	struct kobj_attribute *attr,
+    const char *buf, size_t count)
+{
+   	if (sscanf(buf, "%u", &idle_blank_sec) != 1) {
+		return -EINVAL;
+	}
+	housekeeping_kick();
+   	return count;
+}
+
+static ssize_t stats_decay_sec_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+   	return sprintf(buf, "%u\n", stats_decay_sec);
+}
+
+static ssize_t stats_decay_sec_store(struct kobject *kobj, 
+	struct kobj_attribute *attr,
+    const char *buf, size_t count)
+{
+   	if (sscanf(buf, "%u", &stats_decay_sec) != 1) {
+		return -EINVAL;
+	}
+	housekeeping_kick();
+   	return count;
+}
+
+static ssize_t housekeeping_runs_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+   	return sprintf(buf, "%llu\n", (unsigned long long)housekeeping_runs);
+}
+
+#if GPIOCOUNT_GESTURES
+
+static ssize_t gesture_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+	settle_button();
+   	return sprintf(buf, "%s\n", gc_gesture_names[gestures.last]);
+}
+
+static ssize_t gesture_counts_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+	settle_button();
+   	return sprintf(buf, "short %llu\nlong %llu\ndouble %llu\n",
+		(unsigned long long)gestures.counts[GC_GESTURE_SHORT],
+		(unsigned long long)gestures.counts[GC_GESTURE_LONG],
+		(unsigned long long)gestures.counts[GC_GESTURE_DOUBLE]);
+}
+
+static ssize_t long_press_msec_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+   	return sprintf(buf, "%u\n", gestures.long_msec);
+}
+
+static ssize_t long_press_msec_store(struct kobject *kobj, 
+	struct kobj_attribute *attr,
+    const char *buf, size_t count)
+{
+   	if (sscanf(buf, "%u", &gestures.long_msec) != 1) {
+		return -EINVAL;
+	}
+   	return count;
+}
+
+static ssize_t double_press_msec_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+   	return sprintf(buf, "%u\n", gestures.double_msec);
+}
+
+static ssize_t double_press_msec_store(struct kobject *kobj, 
+	struct kobj_attribute *attr,
+    const char *buf, size_t count)
+{
+   	if (sscanf(buf, "%u", &gestures.double_msec) != 1) {
+		return -EINVAL;
+	}
+   	return count;
+}
+
+static const char *gesture_action_names[GESTURE_ACTIONS] = { 
+	"none", "reset" 
+};
+
+static int
+parse_gesture_action(const char *buf)
+{
+	for (int i = 0; i < GESTURE_ACTIONS; i++) {
+		if (sysfs_streq(buf, gesture_action_names[i])) {
+			return i;
+		}
+	}
+	return -EINVAL;
+}
+
+static ssize_t long_press_action_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+   	return sprintf(buf, "%s\n", gesture_action_names[gestures.long_action]);
+}
+
+static ssize_t long_press_action_store(struct kobject *kobj, 
+	struct kobj_attribute *attr,
+    const char *buf, size_t count)
+{
+	int action = parse_gesture_action(buf);
+	if (action < 0) {
+		return action;
+	}
+	gestures.long_action = action;
+   	return count;
+}
+
+static ssize_t double_press_action_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+   	return sprintf(buf, "%s\n", gesture_action_names[gestures.double_action]);
+}
+
+static ssize_t double_press_action_store(struct kobject *kobj, 
 	struct kobj_attribute *attr,
     const char *buf, size_t count)
 {
-	printk(KERN_INFO "gpiocount: incrementing counter\n");
-	increment_maybe_wrap();
-	set_leds_from_value();
+	int action = parse_gesture_action(buf);
+	if (action < 0) {
+		return action;
+	}
+	gestures.double_action = action;
    	return count;
 }
 
-static ssize_t gpio_button_increment_show(struct kobject *kobj, 
+#endif
+
+static ssize_t debounce_msec_show(struct kobject *kobj, 
 	struct kobj_attribute *attr, char *buf)
 {
-   	return sprintf(buf, "%u\n", gpio_increment_button);
+   	return sprintf(buf, "%llu\n", 
+		(unsigned long long)(inputs[0].debounce.window_ns / NSEC_PER_MSEC));
 }
 
-static ssize_t gpio_button_increment_store(struct kobject *kobj, 
+static ssize_t debounce_msec_store(struct kobject *kobj, 
 	struct kobj_attribute *attr,
     const char *buf, size_t count)
 {
 	uint32_t t;
-   	sscanf(buf, "%u", &t);
-	unassign_increment_button(); // in case we already have one
-	// don't assign until after we've disabled the previous one
-	gpio_increment_button = t;
-	assign_increment_button();
+   	if (sscanf(buf, "%u", &t) != 1) {
+		return -EINVAL;
+	}
+	for (unsigned int i = 0; i < input_count; i++) {
+		inputs[i].debounce.window_ns = (uint64_t)t * NSEC_PER_MSEC;
+	}
+	printk(KERN_INFO "gpiocount: 'debounce_msec' set to %u via sysfs\n", t);
+   	return count;
+}
+
+static ssize_t debounce_stats_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+   	return sprintf(buf, "press_accepted %llu\npress_rejected %llu\n"
+		"release_accepted %llu\nrelease_rejected %llu\nglitches %llu\n"
+		"last_gap_ns %llu\n",
+		(unsigned long long)inputs[0].debounce.presses,
+		(unsigned long long)inputs[0].debounce.press_rejected,
+		(unsigned long long)inputs[0].debounce.releases,
+		(unsigned long long)inputs[0].debounce.release_rejected,
+		(unsigned long long)inputs[0].debounce.glitches,
+		(unsigned long long)inputs[0].debounce.last_gap_ns);
+}
+
+static ssize_t debounce_release_msec_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+   	return sprintf(buf, "%llu\n", (unsigned long long)
+		(inputs[0].debounce.release_window_ns / NSEC_PER_MSEC));
+}
+
+static ssize_t debounce_release_msec_store(struct kobject *kobj, 
+	struct kobj_attribute *attr,
+    const char *buf, size_t count)
+{
+	uint32_t t;
+   	if (sscanf(buf, "%u", &t) != 1) {
+		return -EINVAL;
+	}
+	for (unsigned int i = 0; i < input_count; i++) {
+		inputs[i].debounce.release_window_ns = (uint64_t)t * NSEC_PER_MSEC;
+	}
+	printk(KERN_INFO "gpiocount: 'debounce_release_msec' set to %u via sysfs\n", 
+		t);
+   	return count;
+}
+
+#if GC_DEBOUNCE_GLITCH
+
+static ssize_t min_pulse_usec_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+   	return sprintf(buf, "%llu\n", 
+		(unsigned long long)(inputs[0].debounce.min_pulse_ns / NSEC_PER_USEC));
+}
+
+static ssize_t min_pulse_usec_store(struct kobject *kobj, 
+	struct kobj_attribute *attr,
+    const char *buf, size_t count)
+{
+	uint32_t t;
+   	if (sscanf(buf, "%u", &t) != 1) {
+		return -EINVAL;
+	}
+	for (unsigned int i = 0; i < input_count; i++) {
+		inputs[i].debounce.pending = false;
+		inputs[i].debounce.min_pulse_ns = (uint64_t)t * NSEC_PER_USEC;
+	}
+	printk(KERN_INFO "gpiocount: 'min_pulse_usec' set to %u via sysfs\n", t);
+   	return count;
+}
+
+#endif
+
+#if GC_DEBOUNCE_ADAPT
+
+static ssize_t debounce_adapt_show(struct kobject *kobj, 
+	struct kobj_attribute *attr, char *buf)
+{
+	if (!inputs[0].debounce.adapt_percentile) {
+		return sprintf(buf, "off\n");
+	}
+   	return sprintf(buf, "%u %llu %llu %llu estimate %llu window %llu\n",
+		inputs[0].debounce.adapt_percentile,
+		(unsigned long long)(inputs[0].debounce.adapt_margin_ns / NSEC_PER_USEC),
+		(unsigned long long)(inputs[0].debounce.adapt_min_ns / NSEC_PER_USEC),
+		(unsigned long long)(inputs[0].debounce.adapt_max_ns / NSEC_PER_USEC),
+		(unsigned long long)(inputs[0].debounce.bounce_estimate_ns / NSEC_PER_USEC),
+		(unsigned long long)(inputs[0].debounce.window_ns / NSEC_PER_USEC));
+}
+
+static ssize_t debounce_adapt_store(struct kobject *kobj, 
+	struct kobj_attribute *attr,
+    const char *buf, size_t count)
+{
+	uint32_t percentile, margin_usec, min_usec, max_usec;
+	int fields = sscanf(buf, "%u %u %u %u", 
+		&percentile, &margin_usec, &min_usec, &max_usec);
+	if (fields == 1 && percentile == 0) {
+		for (unsigned int i = 0; i < input_count; i++) {
+			inputs[i].debounce.adapt_percentile = 0;
+		}
+		printk(KERN_INFO "gpiocount: adaptive debounce disabled\n");
+		return count;
+	}
+	if (fields != 4 || percentile > 99 || min_usec > max_usec) {
+		return -EINVAL;
+	}
+	for (unsigned int i = 0; i < input_count; i++) {
+		gc_debounce_adapt(&inputs[i].debounce, percentile, 
+			(uint64_t)margin_usec * NSEC_PER_USEC, 
+			(uint64_t)min_usec * NSEC_PER_USEC, 
+			(uint64_t)max_usec * NSEC_PER_USEC);
+	}
+	printk(KERN_INFO "gpiocount: adaptive debounce at percentile %u\n", 
+		percentile);
    	return count;
 }
 
+#endif
+
 static struct kobj_attribute value_attr = 
 	__ATTR(value, 0644, value_show, value_store);
 static struct kobj_attribute max_value_attr = 
 	__ATTR(max_value, 0644, max_value_show, max_value_store);
 static struct kobj_attribute gpio_leds_attr = 
 	__ATTR(gpio_leds, 0644, gpio_leds_show, gpio_leds_store);
+static struct kobj_attribute display_encoding_attr = 
+	__ATTR(display_encoding, 0644, display_encoding_show, display_encoding_store);
 static struct kobj_attribute increment_attr = 
 	__ATTR_WO(increment);
 static struct kobj_attribute gpio_button_increment_attr = 
 	__ATTR(gpio_button_increment, 0644, 
 		gpio_button_increment_show, gpio_button_increment_store);
+static struct kobj_attribute gpio_inputs_attr = 
+	__ATTR(gpio_inputs, 0644, gpio_inputs_show, gpio_inputs_store);
+static struct kobj_attribute gpio_input_bank_attr = 
+	__ATTR(gpio_input_bank, 0644, gpio_input_bank_show, gpio_input_bank_store);
+#if GPIOCOUNT_TARIFFS
+static struct kobj_attribute tariff_attr = 
+	__ATTR(tariff, 0644, tariff_show, tariff_store);
+static struct kobj_attribute tariff_schedule_attr = 
+	__ATTR(tariff_schedule, 0644, tariff_schedule_show, tariff_schedule_store);
+#endif
+static struct kobj_attribute stall_sec_attr = 
+	__ATTR(stall_sec, 0644, stall_sec_show, stall_sec_store);
+static struct kobj_attribute stall_events_attr = 
+	__ATTR_RO(stall_events);
+static struct kobj_attribute stall_scan_attr = 
+	__ATTR_RO(stall_scan);
+static struct kobj_attribute sim_writes_attr = 
+	__ATTR_RO(sim_writes);
+static struct kobj_attribute sim_edge_attr = 
+	__ATTR_WO(sim_edge);
+#if GPIOCOUNT_LATENCY
+static struct kobj_attribute latency_hist_attr = 
+	__ATTR(latency_hist, 0644, latency_hist_show, latency_hist_store);
+#endif
+static struct kobj_attribute idle_blank_sec_attr = 
+	__ATTR(idle_blank_sec, 0644, idle_blank_sec_show, idle_blank_sec_store);
+static struct kobj_attribute stats_decay_sec_attr = 
+	__ATTR(stats_decay_sec, 0644, stats_decay_sec_show, stats_decay_sec_store);
+static struct kobj_attribute housekeeping_runs_attr = 
+	__ATTR_RO(housekeeping_runs);
+#if GPIOCOUNT_GESTURES
+static struct kobj_attribute gesture_attr = 
+	__ATTR_RO(gesture);
+static struct kobj_attribute gesture_counts_attr = 
+	__ATTR_RO(gesture_counts);
+static struct kobj_attribute long_press_msec_attr = 
+	__ATTR(long_press_msec, 0644, long_press_msec_show, long_press_msec_store);
+static struct kobj_attribute double_press_msec_attr = 
+	__ATTR(double_press_msec, 0644, 
+		double_press_msec_show, double_press_msec_store);
+static struct kobj_attribute long_press_action_attr = 
+	__ATTR(long_press_action, 0644, 
+		long_press_action_show, long_press_action_store);
+static struct kobj_attribute double_press_action_attr = 
+	__ATTR(double_press_action, 0644, 
+		double_press_action_show, double_press_action_store);
+#endif
+static struct kobj_attribute debounce_msec_attr = 
+	__ATTR(debounce_msec, 0644, debounce_msec_show, debounce_msec_store);
+static struct kobj_attribute debounce_release_msec_attr = 
+	__ATTR(debounce_release_msec, 0644, 
+		debounce_release_msec_show, debounce_release_msec_store);
+#if GC_DEBOUNCE_GLITCH
+static struct kobj_attribute min_pulse_usec_attr = 
+	__ATTR(min_pulse_usec, 0644, min_pulse_usec_show, min_pulse_usec_store);
+#endif
+#if GC_DEBOUNCE_ADAPT
+static struct kobj_attribute debounce_adapt_attr = 
+	__ATTR(debounce_adapt, 0644, debounce_adapt_show, debounce_adapt_store);
+#endif
+static struct kobj_attribute debounce_stats_attr = 
+	__ATTR_RO(debounce_stats);
 
 static struct attribute *gpiocount_attrs[] = {
       &value_attr.attr,                  
       &max_value_attr.attr,
 	  &gpio_leds_attr.attr,  
 	  &increment_attr.attr,
+	  &display_encoding_attr.attr,
 	  &gpio_button_increment_attr.attr,
+	  &gpio_inputs_attr.attr,
+	  &gpio_input_bank_attr.attr,
+#if GPIOCOUNT_TARIFFS
+	  &tariff_attr.attr,
+	  &tariff_schedule_attr.attr,
+#endif
+	  &stall_sec_attr.attr,
+	  &stall_events_attr.attr,
+	  &stall_scan_attr.attr,
+	  &sim_writes_attr.attr,
+	  &sim_edge_attr.attr,
+#if GPIOCOUNT_LATENCY
+	  &latency_hist_attr.attr,
+#endif
+	  &idle_blank_sec_attr.attr,
+	  &stats_decay_sec_attr.attr,
+	  &housekeeping_runs_attr.attr,
+#if GPIOCOUNT_GESTURES
+	  &gesture_attr.attr,
+	  &gesture_counts_attr.attr,
+	  &long_press_msec_attr.attr,
+	  &double_press_msec_attr.attr,
+	  &long_press_action_attr.attr,
+	  &double_press_action_attr.attr,
+#endif
+	  &debounce_msec_attr.attr,
+	  &debounce_release_msec_attr.attr,
+#if GC_DEBOUNCE_GLITCH
+	  &min_pulse_usec_attr.attr,
+#endif
+#if GC_DEBOUNCE_ADAPT
+	  &debounce_adapt_attr.attr,
+#endif
+	  &debounce_stats_attr.attr,
       NULL,
 };
 
+/**
+ * Per-input tables -- with an entry or a line per input these outgrow 
+ * the page a sysfs text entry is limited to, so they are binary entries
+ * holding the same text, as is the simulation trace, a line per write. As with 'state', a read at offset 0 renders the
+ * whole table into a buffer of that reader's own, and the rest of the 
+ * read is served from it, so a reader sees one snapshot
+ */
+
+/**
+ * Per-reader snapshots for the bin files below. sysfs gives a bin
+ * attribute no open or release, so a read at offset 0 claims a slot for
+ * its file and renders into it, and the rest of that read is served from
+ * the slot. A slot whose reader reached the end is reused first (keeping
+ * its buffer), then the one started longest ago; a reader that had its
+ * slot taken half-way gets -EAGAIN rather than a torn copy
+ */
+#define SNAPSHOT_READERS 4
+
+struct gpiocount_snapshot {
+	const struct file *filp;
+	unsigned long started;
+	bool done; // read to the end, reuse first
+	char *data;
+	size_t size;
+	size_t length;
+};
+
+static struct gpiocount_snapshot *
+snapshot_find(struct gpiocount_snapshot *slots, const struct file *filp)
+{
+	for (unsigned int i = 0; i < SNAPSHOT_READERS; i++) {
+		if (slots[i].filp == filp) {
+			return &slots[i];
+		}
+	}
+	return NULL;
+}
+
+static struct gpiocount_snapshot *
+snapshot_start(struct gpiocount_snapshot *slots, const struct file *filp, 
+	size_t size)
+{
+	struct gpiocount_snapshot *s = snapshot_find(slots, filp);
+	for (unsigned int i = 0; !s && i < SNAPSHOT_READERS; i++) {
+		if (!slots[i].filp || slots[i].done) {
+			s = &slots[i];
+		}
+	}
+	for (unsigned int i = 0; !s && i < SNAPSHOT_READERS; i++) {
+		if (i == 0 || time_before(slots[i].started, s->started)) {
+			s = &slots[i];
+		}
+	}
+	if (size > s->size) {
+		vfree(s->data);
+		s->data = vzalloc(size);
+		s->size = s->data ? size : 0;
+	}
+	if (!s->data) {
+		s->filp = NULL;
+		return NULL;
+	}
+	s->filp = filp;
+	s->started = jiffies;
+	s->done = false;
+	s->length = 0;
+	return s;
+}
+
+static ssize_t
+snapshot_copy(struct gpiocount_snapshot *s, char *buf, loff_t pos, 
+	size_t count)
+{
+	if (pos >= s->length) {
+		s->done = true;
+		return 0;
+	}
+	size_t length = min(count, (size_t)(s->length - pos));
+	memcpy(buf, s->data + pos, length);
+	return length;
+}
+
+static void
+free_snapshots(struct gpiocount_snapshot *slots)
+{
+	for (unsigned int i = 0; i < SNAPSHOT_READERS; i++) {
+		vfree(slots[i].data);
+		slots[i].data = NULL;
+		slots[i].size = 0;
+		slots[i].filp = NULL;
+	}
+}
+
+struct gpiocount_table {
+	struct bin_attribute attr;
+	size_t entry_max; // longest text for one entry
+	const unsigned int *entries; // how many, or one per input if NULL
+	ssize_t (*render)(char *buf, size_t size);
+	ssize_t (*parse)(const char *buf, size_t count); // one line written
+	struct gpiocount_snapshot readers[SNAPSHOT_READERS];
+};
+
+static DEFINE_MUTEX(table_mutex);
+
+static ssize_t table_read(struct file *filp, struct kobject *kobj,
+	struct bin_attribute *attr, char *buf, loff_t pos, size_t count)
+{
+	struct gpiocount_table *t = container_of(attr, struct gpiocount_table, attr);
+	struct gpiocount_snapshot *s;
+	mutex_lock(&table_mutex);
+	ssize_t result = 0;
+	if (pos == 0) {
+		unsigned int entries = t->entries ? *t->entries : input_count;
+		s = snapshot_start(t->readers, filp, 
+			(size_t)entries * t->entry_max + 2);
+		if (!s) {
+			result = -ENOMEM;
+			goto out;
+		}
+		result = t->render(s->data, s->size);
+		if (result < 0) {
+			s->done = true;
+			goto out;
+		}
+		s->length = result;
+	} else {
+		s = snapshot_find(t->readers, filp);
+		if (!s) {
+			result = -EAGAIN;
+			goto out;
+		}
+	}
+	result = snapshot_copy(s, buf, pos, count);
+out:
+	mutex_unlock(&table_mutex);
+	return result;
+}
+
+static ssize_t table_write(struct file *filp, struct kobject *kobj,
+	struct bin_attribute *attr, char *buf, loff_t pos, size_t count)
+{
+	struct gpiocount_table *t = container_of(attr, struct gpiocount_table, attr);
+	if (pos != 0) {
+		return -EINVAL; // a line fits one write
+	}
+	char *line = kstrndup(buf, count, GFP_KERNEL);
+	if (!line) {
+		return -ENOMEM;
+	}
+	ssize_t result = t->parse(line, count);
+	kfree(line);
+	return result;
+}
+
+static struct gpiocount_table input_counts_table = {
+	.attr = __BIN_ATTR(input_counts, 0444, table_read, NULL, 0),
+	.entry_max = 21, // ",<u64>"
+	.render = input_counts_render,
+};
+static struct gpiocount_table input_rates_table = {
+	.attr = __BIN_ATTR(input_rates, 0444, table_read, NULL, 0),
+	.entry_max = 25, // ",<u64>.<3 digits>"
+	.render = input_rates_render,
+};
+static struct gpiocount_table input_totals_table = {
+	.attr = __BIN_ATTR(input_totals, 0444, table_read, NULL, 0),
+	.entry_max = 26, // ",-<u64>.<3 digits>"
+	.render = input_totals_render,
+};
+static struct gpiocount_table input_scale_table = {
+	.attr = __BIN_ATTR(input_scale, 0644, table_read, table_write, 0),
+	.entry_max = 64,
+	.render = input_scale_render,
+	.parse = input_scale_parse,
+};
+#if GPIOCOUNT_TARIFFS
+static struct gpiocount_table tariff_counts_table = {
+	.attr = __BIN_ATTR(tariff_counts, 0444, table_read, NULL, 0),
+	.entry_max = 6 + MAX_TARIFFS * 21,
+	.render = tariff_counts_render,
+};
+#endif
+static struct gpiocount_table stalled_inputs_table = {
+	.attr = __BIN_ATTR(stalled_inputs, 0444, table_read, NULL, 0),
+	.entry_max = 6, // ",<u16>"
+	.render = stalled_inputs_render,
+};
+
+static struct gpiocount_table sim_trace_table = {
+	.attr = __BIN_ATTR(sim_trace, 0644, table_read, table_write, 0),
+	.entry_max = 34, // "<u64> <u32> <u8>\n"
+	.entries = &sim_trace_len,
+	.render = sim_trace_render,
+	.parse = sim_trace_parse,
+};
+
+static struct gpiocount_table *gpiocount_tables[] = {
+	&input_counts_table,
+	&input_rates_table,
+	&input_totals_table,
+	&input_scale_table,
+#if GPIOCOUNT_TARIFFS
+	&tariff_counts_table,
+#endif
+	&stalled_inputs_table,
+	&sim_trace_table,
+};
+
+static struct bin_attribute *gpiocount_bin_attrs[] = {
+	&input_counts_table.attr,
+	&input_rates_table.attr,
+	&input_totals_table.attr,
+	&input_scale_table.attr,
+#if GPIOCOUNT_TARIFFS
+	&tariff_counts_table.attr,
+#endif
+	&stalled_inputs_table.attr,
+	&sim_trace_table.attr,
+	NULL,
+};
+
+static void
+free_tables(void)
+{
+	for (unsigned int i = 0; i < ARRAY_SIZE(gpiocount_tables); i++) {
+		free_snapshots(gpiocount_tables[i]->readers);
+	}
+}
+
 static struct attribute_group gpiocount_attr_grp = {
 	.attrs = gpiocount_attrs,
+	.bin_attrs = gpiocount_bin_attrs,
 };
 
+#if GPIOCOUNT_EVENTS
+
+static ssize_t events_read(struct file *filp, struct kobject *kobj,
+	struct bin_attribute *attr, char *buf, loff_t pos, size_t count)
+{
+	return read_events(buf, pos, count);
+}
+
+static struct bin_attribute events_attr = 
+	__BIN_ATTR(events, 0444, events_read, NULL, 0);
+
+#endif
+
+/**
+ * Saved state -- see gpiocount_state.h. A read starting at offset 0 takes
+ * a snapshot of its own that the rest of the read is served from (see
+ * struct gpiocount_snapshot), and a write is 
+ * collected until the size given in its header has arrived, then applied
+ * in one go. Each input is copied again if one of its presses came in
+ * between, and all of them if a tariff switch or a restore did, so a
+ * snapshot never splits a press's count from its tariff register, nor
+ * the button's count from the value. Anyone may read it; writing needs
+ * CAP_SYS_ADMIN. GPIOs are not part of the state: assign them 
+ * (gpio_leds, gpio_button_increment, gpio_input_bank, gpio_inputs) 
+ * before writing it back. Display encodings are restored onto the 
+ * groups gpio_leds made, as far as there are as many
+ */
+
+static DEFINE_MUTEX(state_mutex);
+static struct gpiocount_snapshot state_readers[SNAPSHOT_READERS];
+static char *state_staging = NULL;
+static size_t state_staging_size = 0;
+
+static void
+free_state_buffers(void)
+{
+	free_snapshots(state_readers);
+	vfree(state_staging);
+	state_staging = NULL;
+	state_staging_size = 0;
+}
+
+static void
+export_input(const struct gpiocount_input *in, struct gc_state_input *r)
+{
+	const struct gc_debounce *d = &in->debounce;
+	memcpy(r->tariff_counts, in->tariff_counts, sizeof(r->tariff_counts));
+	r->count = in->count;
+	r->scale_milli_pulses = in->scale.milli_pulses;
+	r->scale_offset_milli = in->scale.offset_milli;
+	r->window_ns = d->window_ns;
+	r->release_window_ns = d->release_window_ns;
+	r->min_pulse_ns = d->min_pulse_ns;
+	r->adapt_percentile = d->adapt_percentile;
+	r->adapt_margin_ns = d->adapt_margin_ns;
+	r->adapt_min_ns = d->adapt_min_ns;
+	r->adapt_max_ns = d->adapt_max_ns;
+	r->bounce_estimate_ns = d->bounce_estimate_ns;
+	r->presses = d->presses;
+	r->press_rejected = d->press_rejected;
+	r->releases = d->releases;
+	r->release_rejected = d->release_rejected;
+	r->glitches = d->glitches;
+}
+
+static void
+import_input(struct gpiocount_input *in, const struct gc_state_input *r)
+{
+	struct gc_debounce *d = &in->debounce;
+	memcpy(in->tariff_counts, r->tariff_counts, sizeof(in->tariff_counts));
+	in->count = r->count;
+	in->scale.milli_pulses = r->scale_milli_pulses;
+	in->scale.offset_milli = r->scale_offset_milli;
+	d->window_ns = r->window_ns;
+	d->release_window_ns = r->release_window_ns;
+	d->min_pulse_ns = r->min_pulse_ns;
+	gc_debounce_adapt(d, r->adapt_percentile, r->adapt_margin_ns, 
+		r->adapt_min_ns, r->adapt_max_ns);
+	d->bounce_estimate_ns = r->bounce_estimate_ns;
+	d->presses = r->presses;
+	d->press_rejected = r->press_rejected;
+	d->releases = r->releases;
+	d->release_rejected = r->release_rejected;
+	d->glitches = r->glitches;
+}
+
+static size_t
+state_size(void)
+{
+	return sizeof(struct gc_state_header) + 
+		sizeof(struct gc_state_global) + 
+		(size_t)input_count * sizeof(struct gc_state_input);
+}
+
+static void
+take_state_snapshot(char *blob)
+{
+	BUILD_BUG_ON(MAX_TARIFFS != GC_STATE_TARIFFS);
+	BUILD_BUG_ON(LATENCY_BUCKETS != GC_STATE_LATENCY_BUCKETS);
+	BUILD_BUG_ON(GC_GESTURE_TYPES != 4);
+	BUILD_BUG_ON(MAX_TARIFF_SWITCHES != GC_STATE_TARIFF_SWITCHES);
+	BUILD_BUG_ON(MAX_DISPLAY_GROUPS != GC_STATE_DISPLAY_GROUPS);
+	size_t size = state_size();
+	memset(blob, 0, size);
+	struct gc_state_header *h = (struct gc_state_header *)blob;
+	struct gc_state_global *g = (struct gc_state_global *)(h + 1);
+	struct gc_state_input *records = (struct gc_state_input *)(g + 1);
+	h->magic = GC_STATE_MAGIC;
+	h->version = GC_STATE_VERSION;
+	h->header_len = sizeof(*h);
+	h->global_len = sizeof(*g);
+	h->input_len = sizeof(*records);
+	h->input_count = input_count;
+	h->size = size;
+	g->features = 
+		(GPIOCOUNT_EVENTS ? GC_STATE_FEATURE_EVENTS : 0) | 
+		(GPIOCOUNT_LATENCY ? GC_STATE_FEATURE_LATENCY : 0) | 
+		(GPIOCOUNT_GESTURES ? GC_STATE_FEATURE_GESTURES : 0) | 
+		(GPIOCOUNT_TARIFFS ? GC_STATE_FEATURE_TARIFFS : 0) | 
+		(GPIOCOUNT_BARS ? GC_STATE_FEATURE_BARS : 0) | 
+		(GC_DEBOUNCE_GLITCH ? GC_STATE_FEATURE_GLITCH : 0) | 
+		(GC_DEBOUNCE_ADAPT ? GC_STATE_FEATURE_ADAPT : 0) | 
+		(GPIOCOUNT_PROFILE ? GC_STATE_FEATURE_PROFILE : 0);
+
+	unsigned int seq;
+	do {
+		seq = read_seqcount_begin(&tariff_seq);
+		g->active_tariff = active_tariff;
+		for (unsigned int i = 0; i < input_count; i++) {
+			const struct gpiocount_input *in = &inputs[i];
+			unsigned int in_seq;
+			do {
+				in_seq = read_seqcount_begin(&in->seq);
+				if (i == 0) {
+					// a press of the button also moves the value
+					g->value = counter.value;
+					g->max_value = counter.max_value;
+				}
+				export_input(in, &records[i]);
+			} while (read_seqcount_retry(&in->seq, in_seq));
+		}
+	} while (read_seqcount_retry(&tariff_seq, seq));
+
+	g->idle_blank_sec = idle_blank_sec;
+	g->stats_decay_sec = stats_decay_sec;
+	g->stall_sec = stall_sec;
+	if (GPIOCOUNT_GESTURES) {
+		g->long_press_msec = gestures.long_msec;
+		g->double_press_msec = gestures.double_msec;
+		g->long_press_action = gestures.long_action;
+		g->double_press_action = gestures.double_action;
+		memcpy(g->gesture_counts, gestures.counts, sizeof(g->gesture_counts));
+	}
+	if (GPIOCOUNT_LATENCY) {
+		g->latency_count = latency.count;
+		g->latency_total_ns = latency.total_ns;
+		g->latency_min_ns = latency.min_ns;
+		g->latency_max_ns = latency.max_ns;
+		memcpy(g->latency_buckets, latency.buckets, sizeof(g->latency_buckets));
+	}
+#if GPIOCOUNT_TARIFFS
+	g->tariff_switches = tariff_switches;
+	for (unsigned int i = 0; i < tariff_switches; i++) {
+		g->tariff_switch_second[i] = tariff_schedule[i].second;
+		g->tariff_switch_tariff[i] = tariff_schedule[i].tariff;
+	}
+#endif
+	unsigned long flags;
+	spin_lock_irqsave(&led_lock, flags);
+	g->display_groups = leds_live ? display_group_count : 0;
+	for (unsigned int i = 0; i < g->display_groups; i++) {
+		g->display_encoding[i] = display_groups[i].encoding;
+		g->display_full_hz[i] = display_groups[i].full_hz;
+	}
+	spin_unlock_irqrestore(&led_lock, flags);
+}
+
+static int
+restore_state(const char *blob)
+{
+	const struct gc_state_header *h = (const struct gc_state_header *)blob;
+	const struct gc_state_global *g = 
+		(const struct gc_state_global *)(blob + h->header_len);
+	if (h->input_count != input_count) {
+		printk(KERN_INFO "gpiocount: state has %u inputs, %u assigned\n", 
+			h->input_count, input_count);
+		return -EINVAL;
+	}
+	if (g->active_tariff >= MAX_TARIFFS || 
+		g->long_press_action >= GESTURE_ACTIONS || 
+		g->double_press_action >= GESTURE_ACTIONS || 
+		g->tariff_switches > MAX_TARIFF_SWITCHES || 
+		g->display_groups > MAX_DISPLAY_GROUPS) {
+		return -EINVAL;
+	}
+	for (unsigned int i = 0; i < g->tariff_switches; i++) {
+		if (g->tariff_switch_second[i] >= 86400 || 
+			g->tariff_switch_tariff[i] >= MAX_TARIFFS || 
+			(i > 0 && g->tariff_switch_second[i] < g->tariff_switch_second[i - 1])) {
+			return -EINVAL;
+		}
+	}
+	for (unsigned int i = 0; i < g->display_groups; i++) {
+		uint32_t e = g->display_encoding[i];
+		if (e >= DISPLAY_ENCODINGS || !g->display_full_hz[i] || 
+			(!GPIOCOUNT_BARS && (e == DISPLAY_BAR || e == DISPLAY_LOG_BAR))) {
+			return -EINVAL;
+		}
+	}
+
+	unsigned long flags;
+	spin_lock_irqsave(&tariff_lock, flags);
+	write_seqcount_begin(&tariff_seq);
+	counter.value = g->value;
+	counter.max_value = g->max_value;
+	WRITE_ONCE(active_tariff, g->active_tariff);
+	const char *record = blob + h->header_len + h->global_len;
+	for (unsigned int i = 0; i < input_count; i++, record += h->input_len) {
+		import_input(&inputs[i], (const struct gc_state_input *)record);
+	}
+	write_seqcount_end(&tariff_seq);
+	spin_unlock_irqrestore(&tariff_lock, flags);
+
+	idle_blank_sec = g->idle_blank_sec;
+	stats_decay_sec = g->stats_decay_sec;
+	stall_sec = g->stall_sec;
+	if (GPIOCOUNT_GESTURES) {
+		gestures.long_msec = g->long_press_msec;
+		gestures.double_msec = g->double_press_msec;
+		gestures.long_action = g->long_press_action;
+		gestures.double_action = g->double_press_action;
+		memcpy(gestures.counts, g->gesture_counts, sizeof(gestures.counts));
+	}
+	if (GPIOCOUNT_LATENCY) {
+		latency.count = g->latency_count;
+		latency.total_ns = g->latency_total_ns;
+		latency.min_ns = g->latency_min_ns;
+		latency.max_ns = g->latency_max_ns;
+		memcpy(latency.buckets, g->latency_buckets, sizeof(latency.buckets));
+	}
+#if GPIOCOUNT_TARIFFS
+	// the schedule, if any, sets the tariff again from the time of day
+	alarm_cancel(&tariff_alarm);
+	for (unsigned int i = 0; i < g->tariff_switches; i++) {
+		tariff_schedule[i].second = g->tariff_switch_second[i];
+		tariff_schedule[i].tariff = g->tariff_switch_tariff[i];
+	}
+	tariff_switches = g->tariff_switches;
+	tariff_schedule_apply(ktime_get_real());
+#endif
+	// groups are made by gpio_leds, only their encodings are restored
+	spin_lock_irqsave(&led_lock, flags);
+	for (unsigned int i = 0; leds_live && i < g->display_groups && 
+		i < display_group_count; i++) {
+		set_display_encoding(&display_groups[i], g->display_encoding[i], 
+			g->display_full_hz[i]);
+	}
+	spin_unlock_irqrestore(&led_lock, flags);
+
+	setup_max_possible();
+	set_leds_from_value();
+	clear_stalls();
+	housekeeping_kick();
+	printk(KERN_INFO "gpiocount: restored state of %u inputs\n", input_count);
+	return 0;
+}
+
+static ssize_t state_read(struct file *filp, struct kobject *kobj,
+	struct bin_attribute *attr, char *buf, loff_t pos, size_t count)
+{
+	struct gpiocount_snapshot *s;
+	mutex_lock(&state_mutex);
+	ssize_t result = 0;
+	if (pos == 0) {
+		// the input count, schedule and encodings hold still meanwhile
+		mutex_lock(&config_mutex);
+		size_t size = state_size();
+		s = snapshot_start(state_readers, filp, size);
+		if (s) {
+			take_state_snapshot(s->data);
+			s->length = size;
+		}
+		mutex_unlock(&config_mutex);
+		if (!s) {
+			result = -ENOMEM;
+			goto out;
+		}
+	} else {
+		s = snapshot_find(state_readers, filp);
+		if (!s) {
+			result = -EAGAIN;
+			goto out;
+		}
+	}
+	result = snapshot_copy(s, buf, pos, count);
+out:
+	mutex_unlock(&state_mutex);
+	return result;
+}
+
+static ssize_t state_write(struct file *filp, struct kobject *kobj,
+	struct bin_attribute *attr, char *buf, loff_t pos, size_t count)
+{
+	if (!capable(CAP_SYS_ADMIN)) {
+		return -EPERM;
+	}
+	mutex_lock(&state_mutex);
+	ssize_t result = count;
+	if (pos == 0) {
+		const struct gc_state_header *h = (const struct gc_state_header *)buf;
+		vfree(state_staging);
+		state_staging = NULL;
+		state_staging_size = 0;
+		if (count < sizeof(*h) || h->magic != GC_STATE_MAGIC || 
+			h->version != GC_STATE_VERSION || 
+			h->header_len < sizeof(*h) || 
+			h->global_len < sizeof(struct gc_state_global) || 
+			h->input_len < sizeof(struct gc_state_input) || 
+			h->header_len > PAGE_SIZE || h->global_len > PAGE_SIZE || 
+			h->input_len > PAGE_SIZE || h->input_count > max_inputs || 
+			h->size != h->header_len + h->global_len + 
+				(size_t)h->input_count * h->input_len) {
+			result = -EINVAL;
+			goto out;
+		}
+		state_staging = vmalloc(h->size);
+		if (!state_staging) {
+			result = -ENOMEM;
+			goto out;
+		}
+		state_staging_size = h->size;
+	}
+	if (!state_staging || pos + count > state_staging_size) {
+		result = -EINVAL;
+		goto out;
+	}
+	memcpy(state_staging + pos, buf, count);
+	if (pos + count == state_staging_size) {
+		mutex_lock(&config_mutex);
+		int restored = restore_state(state_staging);
+		mutex_unlock(&config_mutex);
+		if (restored) {
+			result = restored;
+		}
+		vfree(state_staging);
+		state_staging = NULL;
+		state_staging_size = 0;
+	}
+out:
+	mutex_unlock(&state_mutex);
+	return result;
+}
+
+static struct bin_attribute state_attr = 
+	__BIN_ATTR(state, 0644, state_read, state_write, 0);
+
 /**
  * Initialization
  */
@@ -447,12 +3582,30 @@ int gpiocount_init(void)
 {
 	printk(KERN_INFO "gpiocount: initializing\n");
    
-	value = 0u;
-	max_value = 0u;
+	counter.value = 0u;
+	counter.max_value = 0u;
+
+	printk(KERN_INFO "gpiocount: value = %llu, max_value = %llu", 
+		(unsigned long long)counter.value, (unsigned long long)counter.max_value);
+
+	int result = init_inputs();
+	if (result) {
+		return result;
+	}
 
-	printk(KERN_INFO "gpiocount: value = %d, max_value = %d", value, max_value);
+	result = init_event_ring();
+	if (result) {
+		free_inputs();
+		return result;
+	}
 
-	init_debounce();
+	timer_setup(&housekeeping_timer, housekeeping, TIMER_DEFERRABLE);
+#if GPIOCOUNT_GESTURES
+	timer_setup(&release_timer, release_timer_fired, 0);
+#endif
+#if GPIOCOUNT_TARIFFS
+	alarm_init(&tariff_alarm, ALARM_REALTIME, tariff_alarm_fired);
+#endif
 
 	// initialize the hardware first
 
@@ -463,6 +3616,12 @@ int gpiocount_init(void)
 		printk(KERN_INFO "gpiocount: GPIO setup completed\n");
 	} else {
 		printk(KERN_INFO "gpiocount: GPIO disabled\n");
+		result = init_sim_gpio();
+		if (result) {
+			free_event_ring();
+			free_inputs();
+			return result;
+		}
 	}
 
 	// initialize sysfs only after the hardware is available to use
@@ -471,14 +3630,49 @@ int gpiocount_init(void)
 		kobject_create_and_add("gpiocount", kernel_kobj);
 	if (!gpiocount_kobj) {
 		printk(KERN_ALERT "gpiocount: failed to create kobject\n");
+		free_event_ring();
+		free_inputs();
+		free_sim_gpio();
       	return -ENOMEM;
 	}
 
-	int result = sysfs_create_group(gpiocount_kobj, &gpiocount_attr_grp);
+	result = sysfs_create_group(gpiocount_kobj, &gpiocount_attr_grp);
 	if (result) {
 		kobject_put(gpiocount_kobj);
+		free_event_ring();
+		free_inputs();
+		free_sim_gpio();
 		return result;
 	} 
+	stalled_inputs_dirent = sysfs_get_dirent(gpiocount_kobj->sd, "stalled_inputs");
+	if (GPIOCOUNT_GESTURES) {
+		gesture_dirent = sysfs_get_dirent(gpiocount_kobj->sd, "gesture");
+	}
+
+#if GPIOCOUNT_EVENTS
+	if (event_ring) {
+		events_attr.size = (size_t)event_slots * event_slot_size;
+		result = sysfs_create_bin_file(gpiocount_kobj, &events_attr);
+		if (result) {
+			kobject_put(gpiocount_kobj);
+			free_event_ring();
+			free_inputs();
+			free_sim_gpio();
+			return result;
+		}
+	}
+#endif
+
+	result = sysfs_create_bin_file(gpiocount_kobj, &state_attr);
+	if (result) {
+		kobject_put(gpiocount_kobj);
+		free_event_ring();
+		free_inputs();
+		free_sim_gpio();
+		return result;
+	}
+
+	init_profile();
 
     printk(KERN_INFO "gpiocount: initialized\n");
 
@@ -492,13 +3686,42 @@ void gpiocount_exit(void)
 {
 	printk(KERN_INFO "gpiocount: exiting\n");
 	
-	unassign_leds();
-	unassign_buttons();
+	free_profile();
 
+	// remove sysfs and the interrupts first, as both can arm the timers
 	if (gpiocount_kobj != NULL) {
 		printk(KERN_INFO "gpiocount: finalizing sysfs\n");
+#if GPIOCOUNT_EVENTS
+		if (event_ring) {
+			sysfs_remove_bin_file(gpiocount_kobj, &events_attr);
+		}
+#endif
+		sysfs_remove_bin_file(gpiocount_kobj, &state_attr);
 		kobject_put(gpiocount_kobj);
+		gpiocount_kobj = NULL;
+	}
+	unassign_buttons();
+
+	// nothing is left to re-arm them, and the LEDs are no longer written
+	del_timer_sync(&housekeeping_timer);
+#if GPIOCOUNT_GESTURES
+	del_timer_sync(&release_timer);
+#endif
+#if GPIOCOUNT_TARIFFS
+	alarm_cancel(&tariff_alarm);
+#endif
+	sysfs_put(stalled_inputs_dirent);
+	stalled_inputs_dirent = NULL;
+	if (GPIOCOUNT_GESTURES) {
+		sysfs_put(gesture_dirent);
+		gesture_dirent = NULL;
 	}
+	unassign_leds();
+
+	free_state_buffers();
+	free_tables();
+	free_event_ring();
+	free_inputs();
 
 	// finalize the hardware last
 
@@ -508,6 +3731,7 @@ void gpiocount_exit(void)
 		printk(KERN_INFO "gpiocount: finished finalizing GPIO\n");
 	} else {
 		printk(KERN_INFO "gpiocount: no need to finalize GPIO\n");
+		free_sim_gpio();
 	}
 
 
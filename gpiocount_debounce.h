@@ -0,0 +1,242 @@
+#ifndef GPIOCOUNT_DEBOUNCE_H
+#define GPIOCOUNT_DEBOUNCE_H
+
+/**
+ * Debounce and counting decision for a single input -- shared by the
+ * module's interrupt handler and the userspace replay tool, so a recorded
+ * trace replays through exactly the code that runs on the device
+ */
+
+#ifdef __KERNEL__
+#include <linux/string.h>
+#include <linux/types.h>
+#else
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#endif
+
+/**
+ * Optional debounce modes -- define as 0 to compile them out. The module's
+ * Makefile does unless asked for them; the tools build them in
+ */
+#ifndef GC_DEBOUNCE_GLITCH
+#define GC_DEBOUNCE_GLITCH 1	// minimum pulse width filter
+#endif
+#ifndef GC_DEBOUNCE_ADAPT
+#define GC_DEBOUNCE_ADAPT 1	// adaptive press window
+#endif
+
+#define GC_DEBOUNCE_DEFAULT_MSEC 200
+#define GC_ADAPT_MIN_STEP_NS 1000
+
+enum gc_edge_result {
+	GC_EDGE_IGNORE,		// not an edge that can count
+	GC_EDGE_REJECT,		// bounce inside the dead time
+	GC_EDGE_PENDING,	// edge held until its pulse width or window is known
+	GC_EDGE_GLITCH,		// pulse narrower than the minimum width
+	GC_EDGE_COUNT,		// accepted press -- count it
+	GC_EDGE_RELEASE,	// accepted release
+};
+
+/**
+ * Per-input press/release state machine -- each accepted press opens a
+ * dead time of window_ns and each accepted release one of
+ * release_window_ns, in which edges are taken to be bounces. Rejected
+ * rising edges count as press_rejected and rejected falling edges as
+ * release_rejected
+ */
+struct gc_debounce {
+	uint64_t window_ns;	// dead time after an accepted press
+	uint64_t release_window_ns; // dead time after an accepted release
+	uint64_t last_accept_ns;
+	uint64_t last_release_ns;
+	bool primed;		// a press has been accepted
+	bool released;		// a release has been accepted
+	bool pressed;		// current state
+	bool release_held;	// a falling edge inside the press window
+	uint64_t held_release_ns;
+	uint64_t presses;
+	uint64_t press_rejected;
+	uint64_t releases;
+	uint64_t release_rejected;
+	uint64_t last_gap_ns;	// gap of the most recently rejected press edge
+
+	// glitch filter -- disabled while min_pulse_ns is 0
+	uint64_t min_pulse_ns;	// the line must stay high this long to count
+	uint64_t pending_ns;	// rising edge awaiting its falling edge
+	bool pending;
+	uint64_t glitches;
+
+	// adaptive window -- disabled while adapt_percentile is 0
+	uint32_t adapt_percentile;
+	uint32_t adapt_up;	// step weights in 1/1024ths, from the percentile
+	uint32_t adapt_down;
+	uint64_t adapt_margin_ns;
+	uint64_t adapt_min_ns;
+	uint64_t adapt_max_ns;
+	uint64_t bounce_estimate_ns; // running percentile of rejected gaps
+};
+
+static inline void
+gc_debounce_init(struct gc_debounce *d, uint64_t window_ns)
+{
+	memset(d, 0, sizeof(*d));
+	d->window_ns = window_ns;
+}
+
+/**
+ * Enable (percentile 1-99) or disable (percentile 0) window adaptation --
+ * the window then tracks the given percentile of the rejected bounce gaps
+ * plus a margin, kept within [min_ns, max_ns]
+ */
+static inline void
+gc_debounce_adapt(struct gc_debounce *d, uint32_t percentile,
+	uint64_t margin_ns, uint64_t min_ns, uint64_t max_ns)
+{
+	if (percentile > 99) {
+		percentile = 99;
+	}
+	d->adapt_percentile = percentile;
+	d->adapt_up = percentile * 1024 / 100;
+	d->adapt_down = 1024 - d->adapt_up;
+	d->adapt_margin_ns = margin_ns;
+	d->adapt_min_ns = min_ns;
+	d->adapt_max_ns = max_ns > min_ns ? max_ns : min_ns;
+	d->bounce_estimate_ns = d->window_ns > margin_ns ? 
+		d->window_ns - margin_ns : 0;
+}
+
+/**
+ * Move the percentile estimate one step towards a newly observed gap --
+ * a stochastic quantile estimate, so O(1) with no history kept: it settles
+ * where a fraction 'percentile' of the gaps fall below it
+ */
+static inline void
+gc_debounce_learn(struct gc_debounce *d, uint64_t gap)
+{
+	uint64_t step = (d->bounce_estimate_ns >> 4) + GC_ADAPT_MIN_STEP_NS;
+	if (gap > d->bounce_estimate_ns) {
+		d->bounce_estimate_ns += (step * d->adapt_up) >> 10;
+	} else {
+		uint64_t down = (step * d->adapt_down) >> 10;
+		d->bounce_estimate_ns = d->bounce_estimate_ns > down ? 
+			d->bounce_estimate_ns - down : 0;
+	}
+	uint64_t window = d->bounce_estimate_ns + d->adapt_margin_ns;
+	if (window < d->adapt_min_ns) {
+		window = d->adapt_min_ns;
+	} else if (window > d->adapt_max_ns) {
+		window = d->adapt_max_ns;
+	}
+	d->window_ns = window;
+}
+
+static inline enum gc_edge_result
+gc_debounce_press(struct gc_debounce *d, uint64_t ts_ns)
+{
+	d->primed = true;
+	d->pressed = true;
+	d->last_accept_ns = ts_ns;
+	d->presses++;
+	return GC_EDGE_COUNT;
+}
+
+static inline enum gc_edge_result
+gc_debounce_release(struct gc_debounce *d, uint64_t ts_ns)
+{
+	d->released = true;
+	d->pressed = false;
+	d->last_release_ns = ts_ns;
+	d->releases++;
+	return GC_EDGE_RELEASE;
+}
+
+/**
+ * Accept a release held inside the press window once the window is over
+ * -- call with the current time from a timer to see short presses end
+ * without waiting for the next edge, which settles it in any case
+ * @return true if a release was accepted
+ */
+static inline bool
+gc_debounce_settle(struct gc_debounce *d, uint64_t now_ns)
+{
+	if (!d->release_held || now_ns - d->last_accept_ns < d->window_ns) {
+		return false;
+	}
+	d->release_held = false;
+	gc_debounce_release(d, d->held_release_ns);
+	return true;
+}
+
+/**
+ * Classify an edge -- a rising edge (level 1) is a press and counts when
+ * it falls outside both dead times; a falling edge is the release of an
+ * accepted press. Inside the press dead time the latest falling edge is
+ * held, and becomes the release once the dead time is over unless a
+ * rising edge shows it was a bounce, so presses shorter than the window
+ * are still released.
+ * With the glitch filter on, a press is only held until the falling edge
+ * shows that the pulse was at least min_pulse_ns wide, and is then
+ * counted as of its rising edge, with the falling edge as its release
+ */
+static inline enum gc_edge_result
+gc_debounce_edge(struct gc_debounce *d, uint64_t ts_ns, uint8_t level)
+{
+	gc_debounce_settle(d, ts_ns);
+	if (!level) {
+		if (GC_DEBOUNCE_GLITCH && d->pending) {
+			d->pending = false;
+			if (ts_ns - d->pending_ns < d->min_pulse_ns) {
+				d->glitches++;
+				return GC_EDGE_GLITCH;
+			}
+			gc_debounce_press(d, d->pending_ns);
+			gc_debounce_release(d, ts_ns);
+			return GC_EDGE_COUNT;
+		}
+		if (!d->pressed) {
+			return GC_EDGE_IGNORE;
+		}
+		if (ts_ns - d->last_accept_ns < d->window_ns) {
+			// a bounce or the end of a short press -- not a gap worth 
+			// learning either way
+			if (d->release_held) {
+				d->release_rejected++; // a rising edge was missed
+			}
+			d->release_held = true;
+			d->held_release_ns = ts_ns;
+			return GC_EDGE_PENDING;
+		}
+		return gc_debounce_release(d, ts_ns);
+	}
+	if (d->release_held) {
+		// the line came back up -- the held falling edge was a bounce
+		d->release_held = false;
+		d->release_rejected++;
+	}
+	uint64_t gap = ts_ns - d->last_accept_ns;
+	if (d->primed && gap < d->window_ns) {
+		d->press_rejected++;
+		d->last_gap_ns = gap;
+		if (GC_DEBOUNCE_ADAPT && d->adapt_percentile) {
+			gc_debounce_learn(d, gap);
+		}
+		return GC_EDGE_REJECT;
+	}
+	if (d->released && ts_ns - d->last_release_ns < d->release_window_ns) {
+		d->press_rejected++;
+		return GC_EDGE_REJECT;
+	}
+	if (GC_DEBOUNCE_GLITCH && d->min_pulse_ns) {
+		// a repeated rising edge means the falling one was missed -- 
+		// restart the measurement from the latest
+		d->pending = true;
+		d->pending_ns = ts_ns;
+		return GC_EDGE_PENDING;
+	}
+	// pressed already means the release was missed -- count it anyway
+	return gc_debounce_press(d, ts_ns);
+}
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef GPIOCOUNT_EVENT_H
+#define GPIOCOUNT_EVENT_H
+
+/**
+ * Edge event record formats -- shared by the module, which encodes them,
+ * and userspace, which decodes what it reads from the 'events' sysfs entry
+ */
+
+#ifdef __KERNEL__
+#include <linux/string.h>
+#include <linux/types.h>
+#else
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#endif
+
+/**
+ * Full record -- one per edge
+ */
+struct gc_event {
+	uint64_t ts_ns;		// monotonic time of the edge
+	uint32_t seq;		// running edge number, wraps
+	uint16_t input;		// input that saw the edge
+	uint8_t level;		// line level after the edge
+	uint8_t reserved;
+};
+
+/**
+ * Compact block -- the first edge is stored in full as the base record
+ * and every following edge as a varint of its delta from the previous
+ * edge, shifted left by one. Bit 0 is clear for the usual edge, on the
+ * same input as the previous one and with the opposite level, and set
+ * when a second varint follows holding the input shifted left by one,
+ * with the level in bit 0. Deltas count 1024 ns ticks of the timestamp,
+ * a shift rather than a division in the handler, counted from the tick
+ * the base falls in. Decoded times after the base keep its offset into
+ * that tick, so they stay in order and are off by less than a tick. A
+ * one-flag delta fits three bytes up to about a second, so a 128 byte
+ * block holds 4-7 times as many edges as full records (see
+ * tools/gpiocount-eventbench)
+ */
+#define GC_EVENT_BLOCK_SIZE 128
+#define GC_EVENT_BLOCK_DATA (GC_EVENT_BLOCK_SIZE - 16)
+#define GC_EVENT_TICK_SHIFT 10
+#define GC_EVENT_RESOLUTION_NS (1u << GC_EVENT_TICK_SHIFT)
+#define GC_VARINT_MAX 10
+
+struct gc_event_block {
+	uint64_t base_ns;
+	uint32_t base_seq;
+	uint16_t base_input;
+	uint8_t base_level;
+	uint8_t count;		// edges in the block, including the base
+	uint8_t data[GC_EVENT_BLOCK_DATA];
+};
+
+/**
+ * Encoder state for the block currently being filled
+ */
+struct gc_event_writer {
+	uint64_t prev_ticks;
+	uint16_t prev_input;
+	uint8_t prev_level;
+	uint8_t used;		// bytes of data[] in use
+};
+
+static inline unsigned int
+gc_varint_put(uint8_t *p, uint64_t v)
+{
+	unsigned int n = 0;
+	while (v >= 0x80) {
+		p[n++] = (uint8_t)v | 0x80;
+		v >>= 7;
+	}
+	p[n++] = (uint8_t)v;
+	return n;
+}
+
+/**
+ * @return bytes consumed, or 0 if the varint runs past len
+ */
+static inline unsigned int
+gc_varint_get(const uint8_t *p, unsigned int len, uint64_t *v)
+{
+	uint64_t result = 0;
+	for (unsigned int n = 0; n < len && n < GC_VARINT_MAX; n++) {
+		result |= (uint64_t)(p[n] & 0x7f) << (7 * n);
+		if (!(p[n] & 0x80)) {
+			*v = result;
+			return n + 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Start a block with the given edge as its base record
+ */
+static inline void
+gc_block_start(struct gc_event_block *b, struct gc_event_writer *w,
+	const struct gc_event *e)
+{
+	b->base_ns = e->ts_ns;
+	b->base_seq = e->seq;
+	b->base_input = e->input;
+	b->base_level = e->level;
+	b->count = 1;
+	w->prev_ticks = e->ts_ns >> GC_EVENT_TICK_SHIFT;
+	w->prev_input = e->input;
+	w->prev_level = e->level;
+	w->used = 0;
+}
+
+/**
+ * Append an edge to a started block
+ * @return false if the block is full and a new one must be started
+ */
+static inline bool
+gc_block_append(struct gc_event_block *b, struct gc_event_writer *w,
+	const struct gc_event *e)
+{
+	if (b->count == 0xff) {
+		return false;
+	}
+	uint8_t rec[2 * GC_VARINT_MAX];
+	uint64_t ticks = e->ts_ns >> GC_EVENT_TICK_SHIFT;
+	uint64_t delta = ticks > w->prev_ticks ? ticks - w->prev_ticks : 0;
+	bool escape = e->input != w->prev_input || 
+		(e->level & 1) == (w->prev_level & 1);
+	unsigned int len = gc_varint_put(rec, (delta << 1) | escape);
+	if (escape) {
+		len += gc_varint_put(rec + len, 
+			((uint64_t)e->input << 1) | (e->level & 1));
+	}
+	if (w->used + len > GC_EVENT_BLOCK_DATA) {
+		return false;
+	}
+	memcpy(b->data + w->used, rec, len);
+	w->used += len;
+	w->prev_ticks += delta;
+	w->prev_input = e->input;
+	w->prev_level = e->level;
+	b->count++;
+	return true;
+}
+
+/**
+ * Expand a compact block into full records
+ * @return number of records written to out
+ */
+static inline unsigned int
+gc_block_decode(const struct gc_event_block *b, struct gc_event *out,
+	unsigned int max)
+{
+	if (b->count == 0 || max == 0) {
+		return 0;
+	}
+	struct gc_event e;
+	memset(&e, 0, sizeof(e));
+	e.ts_ns = b->base_ns;
+	e.seq = b->base_seq;
+	e.input = b->base_input;
+	e.level = b->base_level;
+	out[0] = e;
+	// the base is not on a tick, so count ticks from its own
+	uint64_t base_ticks = b->base_ns >> GC_EVENT_TICK_SHIFT;
+	uint64_t ticks = base_ticks;
+	unsigned int n = 1;
+	unsigned int pos = 0;
+	while (n < b->count && n < max) {
+		uint64_t v;
+		unsigned int len = gc_varint_get(b->data + pos,
+			GC_EVENT_BLOCK_DATA - pos, &v);
+		if (len == 0) {
+			break;
+		}
+		pos += len;
+		if (v & 1) {
+			uint64_t x;
+			len = gc_varint_get(b->data + pos,
+				GC_EVENT_BLOCK_DATA - pos, &x);
+			if (len == 0) {
+				break;
+			}
+			pos += len;
+			e.input = (uint16_t)(x >> 1);
+			e.level = x & 1;
+		} else {
+			e.level = !e.level;
+		}
+		ticks += v >> 1;
+		e.ts_ns = b->base_ns + ((ticks - base_ticks) << GC_EVENT_TICK_SHIFT);
+		e.seq++;
+		out[n++] = e;
+	}
+	return n;
+}
+
+#endif
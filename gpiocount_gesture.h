@@ -0,0 +1,55 @@
+#ifndef GPIOCOUNT_GESTURE_H
+#define GPIOCOUNT_GESTURE_H
+
+/**
+ * Button gesture classification -- shared, like gpiocount_debounce.h, by
+ * the module and the replay tool. Each accepted release is classified
+ * from the press and release times the debounce state machine keeps: a
+ * long press if held at least long_ns, otherwise a short press, which
+ * becomes a double press if it started within double_ns of the previous
+ * short press ending. Short presses are reported at once rather than
+ * held back to rule out a double
+ */
+
+#include "gpiocount_debounce.h"
+
+enum gc_gesture {
+	GC_GESTURE_NONE,
+	GC_GESTURE_SHORT,
+	GC_GESTURE_LONG,
+	GC_GESTURE_DOUBLE,
+	GC_GESTURE_TYPES,
+};
+
+static const char *const gc_gesture_names[GC_GESTURE_TYPES] = {
+	"none", "short", "long", "double"
+};
+
+struct gc_gesture_tracker {
+	bool short_released;	// a short press could start a double
+	uint64_t short_release_ns;
+};
+
+/**
+ * Classify the release just accepted by d
+ */
+static inline enum gc_gesture
+gc_gesture_classify(struct gc_gesture_tracker *t, const struct gc_debounce *d,
+	uint64_t long_ns, uint64_t double_ns)
+{
+	uint64_t held_ns = d->last_release_ns - d->last_accept_ns;
+	if (held_ns >= long_ns) {
+		t->short_released = false;
+		return GC_GESTURE_LONG;
+	}
+	if (t->short_released &&
+		d->last_accept_ns - t->short_release_ns <= double_ns) {
+		t->short_released = false; // a third press starts afresh
+		return GC_GESTURE_DOUBLE;
+	}
+	t->short_released = true;
+	t->short_release_ns = d->last_release_ns;
+	return GC_GESTURE_SHORT;
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef GPIOCOUNT_STATE_H
+#define GPIOCOUNT_STATE_H
+
+/**
+ * Saved state format -- read from the 'state' sysfs entry before the
+ * module is unloaded and written back after it is loaded again. A header
+ * is followed by the global section and then one record per input, and
+ * the header gives the length of each so that later versions can append
+ * fields that older readers skip
+ */
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+#endif
+
+#define GC_STATE_MAGIC 0x54534347 // "GCST"
+#define GC_STATE_VERSION 3
+#define GC_STATE_TARIFFS 4
+#define GC_STATE_LATENCY_BUCKETS 32
+#define GC_STATE_TARIFF_SWITCHES 16
+#define GC_STATE_DISPLAY_GROUPS 4
+
+/**
+ * Features the module was built with, in gc_state_global.features -- the
+ * fields of a feature that is left out are zero
+ */
+#define GC_STATE_FEATURE_EVENTS		(1u << 0)
+#define GC_STATE_FEATURE_LATENCY	(1u << 1)
+#define GC_STATE_FEATURE_GESTURES	(1u << 2)
+#define GC_STATE_FEATURE_TARIFFS	(1u << 3)
+#define GC_STATE_FEATURE_BARS		(1u << 4)
+#define GC_STATE_FEATURE_GLITCH		(1u << 5)
+#define GC_STATE_FEATURE_ADAPT		(1u << 6)
+#define GC_STATE_FEATURE_PROFILE	(1u << 7)
+
+struct gc_state_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t header_len;
+	uint32_t global_len;
+	uint32_t input_len;	// length of each input record
+	uint32_t input_count;
+	uint32_t size;		// of the whole blob
+};
+
+/**
+ * Counter, configuration and statistics shared by all inputs
+ */
+struct gc_state_global {
+	uint64_t value;
+	uint64_t max_value;
+	uint32_t active_tariff;
+	uint32_t idle_blank_sec;
+	uint32_t stats_decay_sec;
+	uint32_t stall_sec;
+	uint32_t long_press_msec;
+	uint32_t double_press_msec;
+	uint32_t long_press_action;
+	uint32_t double_press_action;
+	uint64_t gesture_counts[4];	// none, short, long, double
+	uint64_t latency_count;
+	uint64_t latency_total_ns;
+	uint64_t latency_min_ns;
+	uint64_t latency_max_ns;
+	uint64_t latency_buckets[GC_STATE_LATENCY_BUCKETS];
+	// since version 2
+	uint32_t tariff_switches;	// entries used below, sorted by time
+	uint32_t tariff_switch_second[GC_STATE_TARIFF_SWITCHES];	// of the day, UTC
+	uint32_t tariff_switch_tariff[GC_STATE_TARIFF_SWITCHES];
+	uint32_t display_groups;	// entries used below
+	uint32_t display_encoding[GC_STATE_DISPLAY_GROUPS];	// binary, gray, bar, logbar
+	uint32_t display_full_hz[GC_STATE_DISPLAY_GROUPS];
+	// since version 3
+	uint32_t features;	// GC_STATE_FEATURE_*, not restored
+	uint32_t reserved;
+};
+
+/**
+ * Counts, debounce settings and statistics of one input
+ */
+struct gc_state_input {
+	uint64_t count;
+	uint64_t tariff_counts[GC_STATE_TARIFFS];
+	uint32_t scale_milli_pulses;
+	uint32_t adapt_percentile;
+	int64_t scale_offset_milli;
+	uint64_t window_ns;
+	uint64_t release_window_ns;
+	uint64_t min_pulse_ns;
+	uint64_t adapt_margin_ns;
+	uint64_t adapt_min_ns;
+	uint64_t adapt_max_ns;
+	uint64_t bounce_estimate_ns;
+	uint64_t presses;
+	uint64_t press_rejected;
+	uint64_t releases;
+	uint64_t release_rejected;
+	uint64_t glitches;
+};
+
+#endif
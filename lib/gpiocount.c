@@ -0,0 +1,345 @@
+/**
+ * libgpiocount -- see gpiocount.h
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gpiocount.h"
+
+// module parameters, relative to the directory, as /sys/kernel/gpiocount
+// is to /sys/module/gpiocount
+#define COMPACT_EVENTS_PARAM "../../module/gpiocount/parameters/compact_events"
+#define TEXT_MAX 4096 // a sysfs text entry is at most a page
+
+struct gpiocount {
+	char dir[256];
+	int state_fd; // -1 when not readable, e.g. an older module
+	int value_fd;
+	char *buf; // state blob, events or input_counts text
+	size_t buf_size;
+	uint64_t *counts; // sysfs fallback
+	unsigned int counts_size;
+	bool seen_events;
+	uint32_t last_seq;
+	int wait_fd;
+	char wait_entry[64];
+};
+
+static int
+open_entry(const struct gpiocount *gc, const char *entry)
+{
+	char path[320];
+	snprintf(path, sizeof(path), "%s/%s", gc->dir, entry);
+	return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+static int
+reserve(struct gpiocount *gc, size_t size)
+{
+	if (size <= gc->buf_size) {
+		return 0;
+	}
+	char *buf = realloc(gc->buf, size);
+	if (!buf) {
+		return -1;
+	}
+	gc->buf = buf;
+	gc->buf_size = size;
+	return 0;
+}
+
+/**
+ * Read a whole entry from the start into gc->buf, growing it as needed
+ * @return bytes read, or -1
+ */
+static ssize_t
+read_all(struct gpiocount *gc, int fd, size_t hint)
+{
+	if (reserve(gc, hint)) {
+		return -1;
+	}
+	size_t length = 0;
+	for (;;) {
+		if (length == gc->buf_size && reserve(gc, gc->buf_size * 2)) {
+			return -1;
+		}
+		ssize_t n = pread(fd, gc->buf + length, gc->buf_size - length,
+			length);
+		if (n < 0) {
+			return -1;
+		}
+		if (n == 0) {
+			return length;
+		}
+		length += n;
+	}
+}
+
+static int
+read_u64(int fd, uint64_t *v)
+{
+	char text[32];
+	ssize_t n = pread(fd, text, sizeof(text) - 1, 0);
+	if (n <= 0) {
+		return -1;
+	}
+	text[n] = '\0';
+	char *end;
+	errno = 0;
+	*v = strtoull(text, &end, 10);
+	if (errno || end == text) {
+		errno = EPROTO;
+		return -1;
+	}
+	return 0;
+}
+
+struct gpiocount *
+gpiocount_open(const char *dir)
+{
+	struct gpiocount *gc = calloc(1, sizeof(*gc));
+	if (!gc) {
+		return NULL;
+	}
+	snprintf(gc->dir, sizeof(gc->dir), "%s", dir ? dir : GPIOCOUNT_SYSFS_DIR);
+	gc->wait_fd = -1;
+	gc->state_fd = open_entry(gc, "state");
+	gc->value_fd = open_entry(gc, "value");
+	if (gc->value_fd < 0) {
+		int saved = errno;
+		gpiocount_close(gc);
+		errno = saved;
+		return NULL;
+	}
+	return gc;
+}
+
+void
+gpiocount_close(struct gpiocount *gc)
+{
+	if (!gc) {
+		return;
+	}
+	if (gc->state_fd >= 0) {
+		close(gc->state_fd);
+	}
+	if (gc->value_fd >= 0) {
+		close(gc->value_fd);
+	}
+	if (gc->wait_fd >= 0) {
+		close(gc->wait_fd);
+	}
+	free(gc->buf);
+	free(gc->counts);
+	free(gc);
+}
+
+int
+gpiocount_value(struct gpiocount *gc, uint64_t *value)
+{
+	return read_u64(gc->value_fd, value);
+}
+
+/**
+ * One read of the state entry -- the kernel takes the whole snapshot at
+ * offset 0, so a blob that outgrew the buffer is simply read again
+ */
+static int
+snapshot_state(struct gpiocount *gc, struct gpiocount_snapshot *snap)
+{
+	ssize_t length = read_all(gc, gc->state_fd,
+		gc->buf_size ? gc->buf_size : TEXT_MAX);
+	if (length < 0) {
+		return -1;
+	}
+	const struct gc_state_header *h = (const struct gc_state_header *)gc->buf;
+	if ((size_t)length < sizeof(*h) || h->magic != GC_STATE_MAGIC ||
+		h->version != GC_STATE_VERSION || h->size != (size_t)length) {
+		errno = EPROTO;
+		return -1;
+	}
+	snap->global = (const struct gc_state_global *)(gc->buf + h->header_len);
+	snap->inputs = (const struct gc_state_input *)
+		(gc->buf + h->header_len + h->global_len);
+	snap->input_len = h->input_len;
+	snap->input_count = h->input_count;
+	snap->value = snap->global->value;
+	snap->max_value = snap->global->max_value;
+	snap->counts = NULL;
+	return 0;
+}
+
+static int
+snapshot_sysfs(struct gpiocount *gc, struct gpiocount_snapshot *snap)
+{
+	memset(snap, 0, sizeof(*snap));
+	if (read_u64(gc->value_fd, &snap->value)) {
+		return -1;
+	}
+	int fd = open_entry(gc, "max_value");
+	if (fd < 0) {
+		return -1;
+	}
+	int result = read_u64(fd, &snap->max_value);
+	close(fd);
+	if (result) {
+		return -1;
+	}
+	fd = open_entry(gc, "input_counts");
+	if (fd < 0) {
+		return -1;
+	}
+	ssize_t length = read_all(gc, fd, TEXT_MAX);
+	close(fd);
+	if (length < 0 || reserve(gc, length + 1)) {
+		return -1;
+	}
+	gc->buf[length] = '\0';
+	unsigned int n = 0;
+	for (char *p = gc->buf; *p && *p != '\n'; n++) {
+		if (n == gc->counts_size) {
+			unsigned int size = n ? n * 2 : 32;
+			uint64_t *counts = realloc(gc->counts, size * sizeof(*counts));
+			if (!counts) {
+				return -1;
+			}
+			gc->counts = counts;
+			gc->counts_size = size;
+		}
+		gc->counts[n] = strtoull(p, &p, 10);
+		if (*p == ',') {
+			p++;
+		}
+	}
+	snap->counts = gc->counts;
+	snap->input_count = n;
+	return 0;
+}
+
+int
+gpiocount_snapshot(struct gpiocount *gc, struct gpiocount_snapshot *snap)
+{
+	if (gc->state_fd >= 0) {
+		return snapshot_state(gc, snap);
+	}
+	return snapshot_sysfs(gc, snap);
+}
+
+uint64_t
+gpiocount_snapshot_count(const struct gpiocount_snapshot *snap,
+	unsigned int input)
+{
+	if (input >= snap->input_count) {
+		return 0;
+	}
+	if (snap->counts) {
+		return snap->counts[input];
+	}
+	const struct gc_state_input *r = (const struct gc_state_input *)
+		((const char *)snap->inputs + (size_t)input * snap->input_len);
+	return r->count;
+}
+
+static bool
+compact_events(const struct gpiocount *gc)
+{
+	char c = 'N';
+	int fd = open_entry(gc, COMPACT_EVENTS_PARAM);
+	if (fd >= 0) {
+		if (pread(fd, &c, 1, 0) != 1) {
+			c = 'N';
+		}
+		close(fd);
+	}
+	return c == 'Y' || c == '1';
+}
+
+/**
+ * Deliver an edge unless an earlier call already did -- sequence numbers
+ * wrap, so compare them as a signed distance
+ */
+static int
+deliver(struct gpiocount *gc, const struct gc_event *e,
+	gpiocount_event_fn fn, void *arg, int *delivered)
+{
+	if (gc->seen_events && (int32_t)(e->seq - gc->last_seq) <= 0) {
+		return 0;
+	}
+	gc->seen_events = true;
+	gc->last_seq = e->seq;
+	(*delivered)++;
+	return fn(e, arg);
+}
+
+int
+gpiocount_events(struct gpiocount *gc, gpiocount_event_fn fn, void *arg)
+{
+	int fd = open_entry(gc, "events");
+	if (fd < 0) {
+		return -1;
+	}
+	ssize_t length = read_all(gc, fd,
+		gc->buf_size > TEXT_MAX ? gc->buf_size : TEXT_MAX);
+	close(fd);
+	if (length < 0) {
+		return -1;
+	}
+	int delivered = 0;
+	if (!compact_events(gc)) {
+		size_t count = length / sizeof(struct gc_event);
+		for (size_t i = 0; i < count; i++) {
+			struct gc_event e;
+			memcpy(&e, gc->buf + i * sizeof(e), sizeof(e));
+			if (deliver(gc, &e, fn, arg, &delivered)) {
+				break;
+			}
+		}
+		return delivered;
+	}
+	size_t blocks = length / sizeof(struct gc_event_block);
+	struct gc_event decoded[0xff];
+	for (size_t b = 0; b < blocks; b++) {
+		struct gc_event_block block;
+		memcpy(&block, gc->buf + b * sizeof(block), sizeof(block));
+		unsigned int n = gc_block_decode(&block, decoded, 0xff);
+		for (unsigned int i = 0; i < n; i++) {
+			if (deliver(gc, &decoded[i], fn, arg, &delivered)) {
+				return delivered;
+			}
+		}
+	}
+	return delivered;
+}
+
+int
+gpiocount_wait(struct gpiocount *gc, const char *entry, int timeout_ms)
+{
+	if (gc->wait_fd < 0 || strcmp(gc->wait_entry, entry) != 0) {
+		if (gc->wait_fd >= 0) {
+			close(gc->wait_fd);
+		}
+		snprintf(gc->wait_entry, sizeof(gc->wait_entry), "%s", entry);
+		gc->wait_fd = open_entry(gc, entry);
+		if (gc->wait_fd < 0) {
+			return -1;
+		}
+	}
+	// sysfs only signals entries that have been read since the last change
+	char text[TEXT_MAX];
+	if (pread(gc->wait_fd, text, sizeof(text), 0) < 0) {
+		return -1;
+	}
+	struct pollfd pfd = { .fd = gc->wait_fd, .events = POLLPRI | POLLERR };
+	int result = poll(&pfd, 1, timeout_ms);
+	if (result < 0) {
+		return -1;
+	}
+	return result > 0 ? 1 : 0;
+}
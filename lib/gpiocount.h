@@ -0,0 +1,86 @@
+#ifndef LIBGPIOCOUNT_H
+#define LIBGPIOCOUNT_H
+
+/**
+ * libgpiocount -- userspace access to the gpiocount module, so consumers
+ * need not parse sysfs themselves. Each call uses the fastest interface
+ * the running module offers:
+ *
+ *   snapshot  -- one read of the binary 'state' entry, or if unreadable
+ *                the text entries 'value', 'max_value' and 'input_counts'
+ *   events    -- the binary 'events' ring, decoded, newest edges only
+ *   wait      -- poll() on a pollable entry such as 'gesture'
+ *
+ * Files are opened once and kept open, and a snapshot points into the
+ * handle's buffer rather than being copied out. A handle is not thread
+ * safe -- use one per thread
+ */
+
+#include <stdint.h>
+
+#include "../gpiocount_event.h"
+#include "../gpiocount_state.h"
+
+#define GPIOCOUNT_SYSFS_DIR "/sys/kernel/gpiocount"
+
+struct gpiocount;
+
+struct gpiocount_snapshot {
+	uint64_t value;
+	uint64_t max_value;
+	unsigned int input_count;
+	const uint64_t *counts; // only with the sysfs fallback, else NULL
+	// only from the state entry, else NULL -- inputs has input_len strides
+	const struct gc_state_global *global;
+	const struct gc_state_input *inputs;
+	uint32_t input_len;
+};
+
+/**
+ * @param dir sysfs directory of the module, or NULL for the default -- its
+ * parameters are looked for at dir/../../module/gpiocount/parameters, 
+ * where they are in sysfs, so a copy of the tree for testing keeps them
+ * in the same place
+ * @return NULL with errno set on failure
+ */
+struct gpiocount *gpiocount_open(const char *dir);
+
+void gpiocount_close(struct gpiocount *gc);
+
+/**
+ * Read the counter and every input's count -- valid until the next call
+ * on the handle
+ * @return 0, or -1 with errno set
+ */
+int gpiocount_snapshot(struct gpiocount *gc, struct gpiocount_snapshot *snap);
+
+/**
+ * Count of one input in a snapshot, whichever backend produced it
+ */
+uint64_t gpiocount_snapshot_count(const struct gpiocount_snapshot *snap,
+	unsigned int input);
+
+/**
+ * Read just the displayed value
+ * @return 0, or -1 with errno set
+ */
+int gpiocount_value(struct gpiocount *gc, uint64_t *value);
+
+typedef int (*gpiocount_event_fn)(const struct gc_event *e, void *arg);
+
+/**
+ * Call fn for each edge in the event ring that is newer than any seen on
+ * this handle before, oldest first -- a non-zero return from fn stops
+ * @return edges delivered, or -1 with errno set (ENOENT if the module
+ * keeps no event ring)
+ */
+int gpiocount_events(struct gpiocount *gc, gpiocount_event_fn fn, void *arg);
+
+/**
+ * Wait for the kernel to signal a change of a pollable entry
+ * @param timeout_ms as for poll(), -1 to wait indefinitely
+ * @return 1 on a change, 0 on timeout, or -1 with errno set
+ */
+int gpiocount_wait(struct gpiocount *gc, const char *entry, int timeout_ms);
+
+#endif
@@ -0,0 +1,124 @@
+/**
+ * Reference userspace counter for benchmarks -- counts rising edges on a
+ * line through the GPIO character device's edge events, the same uAPI
+ * that libgpiod wraps, for a fixed time
+ *
+ *   gpiocount-evcount -s seconds chip_dev line
+ *
+ * Prints "<edges> <cpu_ns> <mean_latency_ns> <max_latency_ns>", where cpu
+ * is this process's user and system time and latency is from the kernel
+ * timestamping an edge to this process reading it
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#define EVENT_BATCH 64
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t
+cpu_ns(void)
+{
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ull +
+		(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ull;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: gpiocount-evcount -s seconds chip_dev line\n");
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	double seconds = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "s:")) != -1) {
+		switch (opt) {
+		case 's':
+			seconds = atof(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 2 || seconds <= 0) {
+		usage();
+	}
+	int chip = open(argv[optind], O_RDONLY | O_CLOEXEC);
+	if (chip < 0) {
+		perror("gpiocount-evcount: chip");
+		return 1;
+	}
+	struct gpio_v2_line_request req;
+	memset(&req, 0, sizeof(req));
+	req.offsets[0] = atoi(argv[optind + 1]);
+	req.num_lines = 1;
+	req.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING;
+	req.event_buffer_size = 1024;
+	snprintf(req.consumer, sizeof(req.consumer), "gpiocount-evcount");
+	if (ioctl(chip, GPIO_V2_GET_LINE_IOCTL, &req) < 0) {
+		perror("gpiocount-evcount: line");
+		return 1;
+	}
+
+	uint64_t end = now_ns() + (uint64_t)(seconds * 1e9);
+	uint64_t edges = 0, latency_total = 0, latency_max = 0;
+	uint64_t cpu_start = cpu_ns();
+	struct gpio_v2_line_event events[EVENT_BATCH];
+	for (;;) {
+		uint64_t now = now_ns();
+		if (now >= end) {
+			break;
+		}
+		struct pollfd pfd = { .fd = req.fd, .events = POLLIN };
+		int ready = poll(&pfd, 1, (int)((end - now) / 1000000) + 1);
+		if (ready < 0 && errno != EINTR) {
+			perror("gpiocount-evcount: poll");
+			return 1;
+		}
+		if (ready <= 0) {
+			continue;
+		}
+		ssize_t n = read(req.fd, events, sizeof(events));
+		if (n < 0) {
+			perror("gpiocount-evcount: read");
+			return 1;
+		}
+		uint64_t read_ns = now_ns();
+		for (size_t i = 0; i < n / sizeof(events[0]); i++) {
+			uint64_t latency = read_ns - events[i].timestamp_ns;
+			latency_total += latency;
+			if (latency > latency_max) {
+				latency_max = latency;
+			}
+			edges++;
+		}
+	}
+	printf("%llu %llu %llu %llu\n", (unsigned long long)edges,
+		(unsigned long long)(cpu_ns() - cpu_start),
+		(unsigned long long)(edges ? latency_total / edges : 0),
+		(unsigned long long)latency_max);
+	return 0;
+}
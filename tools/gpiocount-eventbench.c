@@ -0,0 +1,182 @@
+/**
+ * Compact event record benchmark -- encodes synthetic edge streams with
+ * the module's own encoder from gpiocount_event.h and reports, for each
+ * stream, the edges per block, the saving over full records, the encode
+ * cost per edge and the decode throughput
+ *
+ *   gpiocount-eventbench [-n edges]
+ *
+ * Every decoded edge is checked against the one encoded. The encode cost
+ * is that of the inline encoder alone, in userspace; the cost in the
+ * handler, lock included, is the 'event' phase of the module's profile
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../gpiocount_event.h"
+
+#define DEFAULT_EDGES 1000000
+
+struct stream {
+	const char *name;
+	uint64_t gap_ns; // between edges, or between presses with press_ns
+	uint64_t press_ns; // 0 for a steady pulse train
+	unsigned int inputs; // edges spread round robin over this many inputs
+};
+
+static const struct stream streams[] = {
+	{ "pulses 1 ms", 1000000ull, 0, 1 },
+	{ "pulses 10 ms", 10000000ull, 0, 1 },
+	{ "pulses 100 ms", 100000000ull, 0, 1 },
+	{ "pulses 1 s", 1000000000ull, 0, 1 },
+	{ "presses 100 ms / 2 s", 2000000000ull, 100000000ull, 1 },
+	{ "4 inputs 10 ms", 10000000ull, 0, 4 },
+};
+
+static uint32_t rng = 1;
+
+/**
+ * Gap with +-10% jitter, so deltas are not all one length
+ */
+static uint64_t
+jitter(uint64_t ns)
+{
+	rng = rng * 1103515245u + 12345u;
+	return ns - ns / 10 + (uint64_t)((rng >> 8) % 1000) * (ns / 5) / 1000;
+}
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+generate(const struct stream *s, struct gc_event *events, size_t n)
+{
+	uint64_t t = 1000000000700ull; // as after some uptime, off a tick
+	for (size_t i = 0; i < n; i++) {
+		events[i].ts_ns = t;
+		events[i].seq = (uint32_t)i;
+		events[i].input = (uint16_t)(i % s->inputs);
+		events[i].level = (i / s->inputs) % 2 == 0;
+		events[i].reserved = 0;
+		if (s->press_ns) {
+			t += jitter(events[i].level ? s->press_ns : s->gap_ns);
+		} else {
+			t += jitter(s->gap_ns / s->inputs);
+		}
+	}
+}
+
+static size_t
+encode(const struct gc_event *events, size_t n, struct gc_event_block *blocks)
+{
+	struct gc_event_writer w;
+	size_t used = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (used == 0 || !gc_block_append(&blocks[used - 1], &w, &events[i])) {
+			gc_block_start(&blocks[used++], &w, &events[i]);
+		}
+	}
+	return used;
+}
+
+static int
+check(const struct gc_event *a, const struct gc_event *b)
+{
+	uint64_t error = a->ts_ns > b->ts_ns ? a->ts_ns - b->ts_ns : b->ts_ns - a->ts_ns;
+	return error < GC_EVENT_RESOLUTION_NS && a->seq == b->seq &&
+		a->input == b->input && a->level == b->level ? 0 : -1;
+}
+
+static int
+run(const struct stream *s, size_t n)
+{
+	struct gc_event *events = malloc(n * sizeof(*events));
+	struct gc_event_block *blocks = malloc(n * sizeof(*blocks));
+	struct gc_event decoded[0xff];
+	if (!events || !blocks) {
+		fprintf(stderr, "gpiocount-eventbench: out of memory\n");
+		return -1;
+	}
+	generate(s, events, n);
+
+	uint64_t start = now_ns();
+	size_t used = encode(events, n, blocks);
+	uint64_t encode_ns = now_ns() - start;
+
+	size_t edges = 0;
+	start = now_ns();
+	for (size_t b = 0; b < used; b++) {
+		edges += gc_block_decode(&blocks[b], decoded, 0xff);
+	}
+	uint64_t decode_ns = now_ns() - start;
+
+	// decode again to check every edge, outside the timing
+	size_t i = 0;
+	for (size_t b = 0; b < used; b++) {
+		unsigned int got = gc_block_decode(&blocks[b], decoded, 0xff);
+		for (unsigned int j = 0; j < got; j++, i++) {
+			if (i >= n || check(&events[i], &decoded[j])) {
+				fprintf(stderr, "gpiocount-eventbench: %s: edge %zu "
+					"decoded wrongly\n", s->name, i);
+				return -1;
+			}
+		}
+	}
+	if (edges != n || i != n) {
+		fprintf(stderr, "gpiocount-eventbench: %s: %zu of %zu edges decoded\n",
+			s->name, edges, n);
+		return -1;
+	}
+	printf("%-22s %8.1f %7.2fx %9.1f %10.1f\n", s->name,
+		(double)n / used,
+		(double)(n * sizeof(struct gc_event)) / (used * sizeof(*blocks)),
+		(double)encode_ns / n, n / (decode_ns / 1e3));
+	free(events);
+	free(blocks);
+	return 0;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: gpiocount-eventbench [-n edges]\n");
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	size_t n = DEFAULT_EDGES;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			n = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc || n == 0) {
+		usage();
+	}
+	printf("%zu edges, %zu byte blocks against %zu byte records\n", n,
+		sizeof(struct gc_event_block), sizeof(struct gc_event));
+	printf("%-22s %8s %8s %9s %10s\n", "stream", "edges/blk", "saving",
+		"enc ns", "dec Medge/s");
+	for (size_t s = 0; s < sizeof(streams) / sizeof(streams[0]); s++) {
+		if (run(&streams[s], n)) {
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,349 @@
+/**
+ * Prometheus exporter -- serves the module's counters, rates, latency
+ * histogram and debounce statistics over HTTP, in the text exposition
+ * format, for any path requested
+ *
+ *   gpiocount-exporter [-a address] [-p port] [-d sysfs_dir]
+ *
+ * Listens on 127.0.0.1:9477 by default. Each scrape takes one snapshot
+ * through libgpiocount (the binary state entry, else the text entries)
+ * plus one read of input_rates, and renders it into a buffer that is
+ * kept between scrapes, so a steady scrape rate does no allocation.
+ * Scrapes are served one at a time, so a client that stalls sending its
+ * request or reading the response is dropped after CLIENT_TIMEOUT_SEC
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "../lib/gpiocount.h"
+
+#define DEFAULT_PORT 9477
+#define REQUEST_MAX 4096
+#define CLIENT_TIMEOUT_SEC 5
+
+static char *out = NULL;
+static size_t out_size = 0;
+static size_t out_length = 0;
+static int out_failed = 0;
+
+static char *rates = NULL; // input_rates text
+static size_t rates_size = 0;
+
+/**
+ * Append to the response, growing the buffer only when a scrape is
+ * bigger than any before
+ */
+static void
+emit(const char *fmt, ...)
+{
+	for (;;) {
+		va_list ap;
+		va_start(ap, fmt);
+		int n = vsnprintf(out + out_length, out_size - out_length, fmt, ap);
+		va_end(ap);
+		if (n < 0) {
+			out_failed = 1;
+			return;
+		}
+		if ((size_t)n < out_size - out_length) {
+			out_length += n;
+			return;
+		}
+		size_t size = out_size ? out_size * 2 : 65536;
+		while (size - out_length <= (size_t)n) {
+			size *= 2;
+		}
+		char *grown = realloc(out, size);
+		if (!grown) {
+			out_failed = 1;
+			return;
+		}
+		out = grown;
+		out_size = size;
+	}
+}
+
+static void
+header(const char *name, const char *type, const char *help)
+{
+	emit("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static int
+read_rates(int fd)
+{
+	if (fd < 0) {
+		return -1;
+	}
+	size_t length = 0;
+	for (;;) {
+		if (length + 1 >= rates_size) {
+			size_t size = rates_size ? rates_size * 2 : 4096;
+			char *grown = realloc(rates, size);
+			if (!grown) {
+				return -1;
+			}
+			rates = grown;
+			rates_size = size;
+		}
+		ssize_t n = pread(fd, rates + length, rates_size - length - 1, length);
+		if (n < 0) {
+			return -1;
+		}
+		if (n == 0) {
+			break;
+		}
+		length += n;
+	}
+	rates[length] = '\0';
+	return 0;
+}
+
+static void
+render_rates(void)
+{
+	header("gpiocount_input_rate_hz", "gauge",
+		"Pulse rate over roughly the last 8 seconds.");
+	char *p = rates;
+	for (unsigned int i = 0; *p && *p != '\n'; i++) {
+		char *end = strpbrk(p, ",\n");
+		size_t length = end ? (size_t)(end - p) : strlen(p);
+		emit("gpiocount_input_rate_hz{input=\"%u\"} %.*s\n", i, (int)length, p);
+		p += length;
+		if (*p == ',') {
+			p++;
+		}
+	}
+}
+
+static const struct gc_state_input *
+record(const struct gpiocount_snapshot *snap, unsigned int i)
+{
+	return (const struct gc_state_input *)
+		((const char *)snap->inputs + (size_t)i * snap->input_len);
+}
+
+#define PER_INPUT(name, type, help, field) \
+	do { \
+		header(name, type, help); \
+		for (unsigned int i = 0; i < snap->input_count; i++) { \
+			emit(name "{input=\"%u\"} %llu\n", i, \
+				(unsigned long long)record(snap, i)->field); \
+		} \
+	} while (0)
+
+static void
+render_state(const struct gpiocount_snapshot *snap)
+{
+	// families of features the module was built without are left out
+	const struct gc_state_global *g = snap->global;
+	PER_INPUT("gpiocount_debounce_presses_total", "counter",
+		"Accepted press edges.", presses);
+	PER_INPUT("gpiocount_debounce_press_rejected_total", "counter",
+		"Press edges rejected as bounces of a press or release.", press_rejected);
+	PER_INPUT("gpiocount_debounce_releases_total", "counter",
+		"Accepted release edges.", releases);
+	PER_INPUT("gpiocount_debounce_release_rejected_total", "counter",
+		"Release edges rejected as bounces.", release_rejected);
+	if (g->features & GC_STATE_FEATURE_GLITCH) {
+		PER_INPUT("gpiocount_debounce_glitches_total", "counter",
+			"Pulses narrower than the minimum width.", glitches);
+	}
+
+	if (g->features & GC_STATE_FEATURE_TARIFFS) {
+		header("gpiocount_input_tariff_pulses_total", "counter",
+			"Counted pulses per tariff.");
+		for (unsigned int i = 0; i < snap->input_count; i++) {
+			for (unsigned int t = 0; t < GC_STATE_TARIFFS; t++) {
+				emit("gpiocount_input_tariff_pulses_total{input=\"%u\",tariff=\"%u\"}"
+					" %llu\n", i, t,
+					(unsigned long long)record(snap, i)->tariff_counts[t]);
+			}
+		}
+	}
+
+	if (!(g->features & GC_STATE_FEATURE_LATENCY)) {
+		return;
+	}
+	// the module halves these every stats_decay_sec, so they can go down
+	// and are gauges of recent presses, not a Prometheus histogram; bucket
+	// i holds latencies below 2^i ns, the last one everything else
+	header("gpiocount_latency_recent_presses", "gauge",
+		"Recent button presses with an edge-to-LED latency up to le seconds.");
+	uint64_t cumulative = 0;
+	for (unsigned int i = 0; i < GC_STATE_LATENCY_BUCKETS - 1; i++) {
+		cumulative += g->latency_buckets[i];
+		emit("gpiocount_latency_recent_presses{le=\"%.9g\"} %llu\n",
+			(double)(1ull << i) / 1e9, (unsigned long long)cumulative);
+	}
+	emit("gpiocount_latency_recent_presses{le=\"+Inf\"} %llu\n",
+		(unsigned long long)g->latency_count);
+	header("gpiocount_latency_mean_seconds", "gauge",
+		"Mean edge-to-LED latency of recent button presses.");
+	emit("gpiocount_latency_mean_seconds %.9g\n", g->latency_count ? 
+		(double)g->latency_total_ns / g->latency_count / 1e9 : 0.0);
+	header("gpiocount_latency_max_seconds", "gauge",
+		"Highest edge-to-LED latency since the statistics were cleared.");
+	emit("gpiocount_latency_max_seconds %.9g\n",
+		(double)g->latency_max_ns / 1e9);
+}
+
+static int
+render(struct gpiocount *gc, int rates_fd)
+{
+	struct gpiocount_snapshot snap;
+	out_length = 0;
+	out_failed = 0;
+	if (gpiocount_snapshot(gc, &snap)) {
+		return -1;
+	}
+	header("gpiocount_value", "gauge", "Value shown on the LEDs.");
+	emit("gpiocount_value %llu\n", (unsigned long long)snap.value);
+	header("gpiocount_max_value", "gauge", "Highest value reached.");
+	emit("gpiocount_max_value %llu\n", (unsigned long long)snap.max_value);
+	header("gpiocount_input_pulses_total", "counter", "Counted pulses.");
+	for (unsigned int i = 0; i < snap.input_count; i++) {
+		emit("gpiocount_input_pulses_total{input=\"%u\"} %llu\n", i,
+			(unsigned long long)gpiocount_snapshot_count(&snap, i));
+	}
+	if (snap.global) {
+		render_state(&snap);
+	}
+	if (read_rates(rates_fd) == 0) {
+		render_rates();
+	}
+	return out_failed ? -1 : 0;
+}
+
+static int
+write_all(int fd, const char *p, size_t length)
+{
+	while (length > 0) {
+		ssize_t n = write(fd, p, length);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		p += n;
+		length -= n;
+	}
+	return 0;
+}
+
+static void
+serve(int client, struct gpiocount *gc, int rates_fd)
+{
+	// a stalled client must not hold up the scrapes queued behind it
+	struct timeval timeout = { .tv_sec = CLIENT_TIMEOUT_SEC };
+	if (setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) ||
+		setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout))) {
+		return;
+	}
+	// the request itself does not matter -- read what has arrived
+	char request[REQUEST_MAX];
+	if (read(client, request, sizeof(request)) <= 0) {
+		return;
+	}
+	char head[160];
+	if (render(gc, rates_fd)) {
+		int n = snprintf(head, sizeof(head), "HTTP/1.0 500 Internal Server Error\r\n"
+			"Content-Length: 0\r\nConnection: close\r\n\r\n");
+		write_all(client, head, n);
+		return;
+	}
+	int n = snprintf(head, sizeof(head), "HTTP/1.0 200 OK\r\n"
+		"Content-Type: text/plain; version=0.0.4\r\n"
+		"Content-Length: %zu\r\nConnection: close\r\n\r\n", out_length);
+	if (write_all(client, head, n) == 0) {
+		write_all(client, out, out_length);
+	}
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: gpiocount-exporter [-a address] [-p port] "
+		"[-d sysfs_dir]\n");
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *address = "127.0.0.1";
+	const char *dir = NULL;
+	int port = DEFAULT_PORT;
+	int opt;
+	while ((opt = getopt(argc, argv, "a:p:d:")) != -1) {
+		switch (opt) {
+		case 'a':
+			address = optarg;
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc || port <= 0 || port > 65535) {
+		usage();
+	}
+
+	struct gpiocount *gc = gpiocount_open(dir);
+	if (!gc) {
+		perror("gpiocount-exporter: open");
+		return 1;
+	}
+	char path[320];
+	snprintf(path, sizeof(path), "%s/input_rates",
+		dir ? dir : GPIOCOUNT_SYSFS_DIR);
+	int rates_fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	struct sockaddr_in sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(port);
+	if (inet_pton(AF_INET, address, &sa.sin_addr) != 1) {
+		fprintf(stderr, "gpiocount-exporter: bad address %s\n", address);
+		return 1;
+	}
+	int server = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	int one = 1;
+	if (server < 0 ||
+		setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) ||
+		bind(server, (struct sockaddr *)&sa, sizeof(sa)) ||
+		listen(server, 16)) {
+		perror("gpiocount-exporter: listen");
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+	for (;;) {
+		int client = accept(server, NULL, NULL);
+		if (client < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("gpiocount-exporter: accept");
+			return 1;
+		}
+		serve(client, gc, rates_fd);
+		close(client);
+	}
+}
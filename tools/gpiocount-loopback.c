@@ -0,0 +1,141 @@
+/**
+ * Edge-to-LED loopback latency -- presses a gpio-sim button line by
+ * writing its 'pull' attribute and times how long the LED line showing
+ * the value's lowest bit takes to follow, read back through its 'value'
+ * attribute, so the whole path is measured from outside the module
+ *
+ *   gpiocount-loopback [-n presses] [-i interval_ms] pull_file value_file
+ *
+ * pull_file is e.g. /sys/devices/platform/gpio-sim.0/gpiochip5/sim_gpio0/pull
+ * and value_file the 'value' of the LED line. Each press flips the lowest
+ * bit, so the LED changes once per press. The debounce window must be
+ * shorter than the interval. Prints "<presses> <mean_ns> <p50_ns>
+ * <p99_ns> <max_ns>". A time includes the pull write returning and the
+ * polling reads, a few microseconds on most machines, so compare it with
+ * the module's own latency_hist rather than read it as the exact cost
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_PRESSES 1000
+#define TIMEOUT_NS 1000000000ull // per press
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int
+set_pull(int fd, int up)
+{
+	const char *value = up ? "pull-up" : "pull-down";
+	return pwrite(fd, value, strlen(value), 0) < 0 ? -1 : 0;
+}
+
+static int
+get_value(int fd)
+{
+	char c;
+	return pread(fd, &c, 1, 0) == 1 ? c == '1' : -1;
+}
+
+static int
+compare(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: gpiocount-loopback [-n presses] "
+		"[-i interval_ms] pull_file value_file\n");
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned long presses = DEFAULT_PRESSES;
+	double interval_ms = 20;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:i:")) != -1) {
+		switch (opt) {
+		case 'n':
+			presses = strtoul(optarg, NULL, 10);
+			break;
+		case 'i':
+			interval_ms = atof(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 2 || presses == 0 || interval_ms <= 0) {
+		usage();
+	}
+	int pull = open(argv[optind], O_WRONLY | O_CLOEXEC);
+	int led = open(argv[optind + 1], O_RDONLY | O_CLOEXEC);
+	uint64_t *times = calloc(presses, sizeof(*times));
+	if (pull < 0 || led < 0 || !times || set_pull(pull, 0)) {
+		perror("gpiocount-loopback");
+		return 1;
+	}
+	struct timespec gap = {
+		.tv_sec = (time_t)(interval_ms / 1000),
+		.tv_nsec = (long)((uint64_t)(interval_ms * 1e6) % 1000000000ull),
+	};
+	nanosleep(&gap, NULL);
+
+	for (unsigned long i = 0; i < presses; i++) {
+		int before = get_value(led);
+		uint64_t start = now_ns();
+		if (before < 0 || set_pull(pull, 1)) {
+			perror("gpiocount-loopback");
+			return 1;
+		}
+		int now;
+		while ((now = get_value(led)) == before) {
+			if (now_ns() - start > TIMEOUT_NS) {
+				fprintf(stderr, "gpiocount-loopback: press %lu: LED did "
+					"not change -- are the LEDs and button assigned?\n", i);
+				return 1;
+			}
+		}
+		times[i] = now_ns() - start;
+		if (now < 0) {
+			perror("gpiocount-loopback");
+			return 1;
+		}
+		nanosleep(&gap, NULL);
+		if (set_pull(pull, 0)) {
+			perror("gpiocount-loopback");
+			return 1;
+		}
+		nanosleep(&gap, NULL);
+	}
+
+	uint64_t total = 0;
+	for (unsigned long i = 0; i < presses; i++) {
+		total += times[i];
+	}
+	qsort(times, presses, sizeof(*times), compare);
+	printf("%lu %llu %llu %llu %llu\n", presses,
+		(unsigned long long)(total / presses),
+		(unsigned long long)times[presses / 2],
+		(unsigned long long)times[presses * 99 / 100],
+		(unsigned long long)times[presses - 1]);
+	free(times);
+	return 0;
+}
@@ -0,0 +1,105 @@
+/**
+ * Pulse generator for benchmarks -- toggles a gpio-sim line by writing
+ * its 'pull' attribute, at a fixed rate for a fixed time
+ *
+ *   gpiocount-pulse -r rate_hz -s seconds pull_file
+ *
+ * pull_file is e.g. /sys/devices/platform/gpio-sim.0/gpiochip5/sim_gpio0/pull.
+ * Each pulse is a rising then a falling edge, with the period split
+ * evenly. Prints the pulses sent and the rate achieved, as
+ * "<pulses> <achieved_hz>", since at high rates the writes themselves
+ * limit the rate
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+sleep_until(uint64_t deadline_ns)
+{
+	struct timespec ts = {
+		.tv_sec = deadline_ns / 1000000000ull,
+		.tv_nsec = deadline_ns % 1000000000ull,
+	};
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+	}
+}
+
+static int
+set_pull(int fd, int up)
+{
+	const char *value = up ? "pull-up" : "pull-down";
+	return pwrite(fd, value, strlen(value), 0) < 0 ? -1 : 0;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: gpiocount-pulse -r rate_hz -s seconds pull_file\n");
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	double rate = 0, seconds = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "r:s:")) != -1) {
+		switch (opt) {
+		case 'r':
+			rate = atof(optarg);
+			break;
+		case 's':
+			seconds = atof(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 1 || rate <= 0 || seconds <= 0) {
+		usage();
+	}
+	int fd = open(argv[optind], O_WRONLY | O_CLOEXEC);
+	if (fd < 0 || set_pull(fd, 0)) {
+		perror("gpiocount-pulse");
+		return 1;
+	}
+
+	uint64_t half_ns = (uint64_t)(5e8 / rate);
+	uint64_t start = now_ns();
+	uint64_t end = start + (uint64_t)(seconds * 1e9);
+	uint64_t next = start;
+	uint64_t pulses = 0;
+	while (next < end) {
+		if (set_pull(fd, 1)) {
+			perror("gpiocount-pulse");
+			return 1;
+		}
+		next += half_ns;
+		sleep_until(next);
+		if (set_pull(fd, 0)) {
+			perror("gpiocount-pulse");
+			return 1;
+		}
+		pulses++;
+		next += half_ns;
+		sleep_until(next);
+	}
+	double elapsed = (now_ns() - start) / 1e9;
+	printf("%llu %.1f\n", (unsigned long long)pulses, pulses / elapsed);
+	return 0;
+}
@@ -0,0 +1,298 @@
+/**
+ * Offline replay of recorded edges through the module's debounce code,
+ * to compare candidate debounce windows without touching the hardware
+ *
+ *   gpiocount-replay [-c | -t] [-i input] [-w ms,ms,...] [-r release_ms]
+ *                    [-p min_pulse_us] [-a percentile,margin_us,min_us,max_us]
+ *                    [-g long_ms,double_ms] file
+ *
+ * The file is a dump of /sys/kernel/gpiocount/events (full records by
+ * default, compact blocks with -c) or, with -t, text with one edge per
+ * line: a nanosecond timestamp optionally followed by the level
+ *
+ * With -a each window is only the starting point for adaptive debouncing,
+ * and the window it settles on is reported as well. With -g every release
+ * is also classified as a button gesture, as the module does for the
+ * button, and the gestures are listed after each result row
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../gpiocount_debounce.h"
+#include "../gpiocount_event.h"
+#include "../gpiocount_gesture.h"
+
+#define MAX_WINDOWS 64
+#define MAX_GESTURES 64 // listed per row
+
+struct edge {
+	uint64_t ts_ns;
+	uint8_t level;
+};
+
+static uint64_t release_window_ns = 0;
+static uint64_t min_pulse_ns = 0;
+static uint32_t adapt_percentile = 0;
+static uint64_t adapt_margin_ns, adapt_min_ns, adapt_max_ns;
+static uint64_t long_press_ns = 0; // 0 without -g
+static uint64_t double_press_ns = 0;
+
+static struct edge *edges = NULL;
+static size_t edge_count = 0;
+static size_t edge_capacity = 0;
+
+static int
+add_edge(uint64_t ts_ns, uint8_t level)
+{
+	if (edge_count == edge_capacity) {
+		size_t capacity = edge_capacity ? edge_capacity * 2 : 65536;
+		struct edge *e = realloc(edges, capacity * sizeof(*e));
+		if (!e) {
+			return -ENOMEM;
+		}
+		edges = e;
+		edge_capacity = capacity;
+	}
+	edges[edge_count].ts_ns = ts_ns;
+	edges[edge_count].level = level;
+	edge_count++;
+	return 0;
+}
+
+static int
+load_text(FILE *f)
+{
+	char line[128];
+	while (fgets(line, sizeof(line), f)) {
+		unsigned long long ts;
+		unsigned int level = 1;
+		if (sscanf(line, "%llu %u", &ts, &level) < 1) {
+			continue;
+		}
+		if (add_edge(ts, level ? 1 : 0)) {
+			return -ENOMEM;
+		}
+	}
+	return 0;
+}
+
+static int
+load_full(FILE *f, int input)
+{
+	struct gc_event e;
+	while (fread(&e, sizeof(e), 1, f) == 1) {
+		if (input >= 0 && e.input != input) {
+			continue;
+		}
+		if (add_edge(e.ts_ns, e.level)) {
+			return -ENOMEM;
+		}
+	}
+	return 0;
+}
+
+static int
+load_compact(FILE *f, int input)
+{
+	struct gc_event_block b;
+	struct gc_event out[256];
+	while (fread(&b, sizeof(b), 1, f) == 1) {
+		unsigned int n = gc_block_decode(&b, out, 256);
+		for (unsigned int i = 0; i < n; i++) {
+			if (input >= 0 && out[i].input != input) {
+				continue;
+			}
+			if (add_edge(out[i].ts_ns, out[i].level)) {
+				return -ENOMEM;
+			}
+		}
+	}
+	return 0;
+}
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * Run every edge through one debounce setting and print a result row
+ */
+static void
+replay(double window_ms)
+{
+	struct gc_debounce d;
+	gc_debounce_init(&d, (uint64_t)(window_ms * 1e6));
+	d.release_window_ns = release_window_ns;
+	d.min_pulse_ns = min_pulse_ns;
+	if (adapt_percentile) {
+		gc_debounce_adapt(&d, adapt_percentile, adapt_margin_ns,
+			adapt_min_ns, adapt_max_ns);
+	}
+	uint64_t min_gap = UINT64_MAX;
+	uint64_t max_gap = 0;
+	struct gc_gesture_tracker tracker;
+	memset(&tracker, 0, sizeof(tracker));
+	enum gc_gesture gestures[MAX_GESTURES];
+	unsigned int gesture_count = 0;
+	for (size_t i = 0; i < edge_count; i++) {
+		uint64_t last_gap = d.last_gap_ns;
+		uint64_t press_rejected = d.press_rejected;
+		// the same order as the module's input_edge()
+		if (gc_debounce_settle(&d, edges[i].ts_ns) && long_press_ns &&
+			gesture_count < MAX_GESTURES) {
+			gestures[gesture_count++] = gc_gesture_classify(&tracker, &d,
+				long_press_ns, double_press_ns);
+		}
+		enum gc_edge_result result = gc_debounce_edge(&d, edges[i].ts_ns,
+			edges[i].level);
+		if ((result == GC_EDGE_RELEASE ||
+			(result == GC_EDGE_COUNT && !d.pressed)) && long_press_ns &&
+			gesture_count < MAX_GESTURES) {
+			gestures[gesture_count++] = gc_gesture_classify(&tracker, &d,
+				long_press_ns, double_press_ns);
+		}
+		// only rising edges rejected in the press window record their gap
+		if (d.press_rejected != press_rejected && d.last_gap_ns != last_gap) {
+			if (d.last_gap_ns < min_gap) {
+				min_gap = d.last_gap_ns;
+			}
+			if (d.last_gap_ns > max_gap) {
+				max_gap = d.last_gap_ns;
+			}
+		}
+	}
+	// the trace is over, so a release held in the last window stands
+	if (gc_debounce_settle(&d, UINT64_MAX) && long_press_ns &&
+		gesture_count < MAX_GESTURES) {
+		gestures[gesture_count++] = gc_gesture_classify(&tracker, &d,
+			long_press_ns, double_press_ns);
+	}
+	uint64_t rejected = d.press_rejected + d.release_rejected;
+	uint64_t candidates = d.presses + rejected;
+	printf("%10.3f %10.3f %10llu %10llu %10llu %10llu %10llu %7.2f %12.1f %12.1f\n",
+		window_ms, d.window_ns / 1e6,
+		(unsigned long long)d.presses, (unsigned long long)d.press_rejected,
+		(unsigned long long)d.releases, (unsigned long long)d.release_rejected,
+		(unsigned long long)d.glitches,
+		candidates ? 100.0 * rejected / candidates : 0.0,
+		min_gap != UINT64_MAX ? min_gap / 1e3 : 0.0,
+		max_gap / 1e3);
+	if (long_press_ns) {
+		printf("gestures");
+		for (unsigned int i = 0; i < gesture_count; i++) {
+			printf(" %s", gc_gesture_names[gestures[i]]);
+		}
+		printf("\n");
+	}
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: gpiocount-replay [-c | -t] [-i input] "
+		"[-w ms,ms,...] [-r release_ms] [-p min_pulse_us]\n"
+		"       [-a percentile,margin_us,min_us,max_us] "
+		"[-g long_ms,double_ms] file\n");
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	enum { FULL, COMPACT, TEXT } format = FULL;
+	int input = -1;
+	double windows[MAX_WINDOWS];
+	int window_count = 0;
+	int opt;
+	unsigned int margin_us, min_us, max_us;
+	unsigned int long_ms, double_ms;
+	while ((opt = getopt(argc, argv, "cti:w:r:p:a:g:")) != -1) {
+		switch (opt) {
+		case 'c':
+			format = COMPACT;
+			break;
+		case 't':
+			format = TEXT;
+			break;
+		case 'i':
+			input = atoi(optarg);
+			break;
+		case 'w':
+			for (char *tok = strtok(optarg, ",");
+				tok && window_count < MAX_WINDOWS;
+				tok = strtok(NULL, ",")) {
+				windows[window_count++] = strtod(tok, NULL);
+			}
+			break;
+		case 'r':
+			release_window_ns = (uint64_t)(strtod(optarg, NULL) * 1e6);
+			break;
+		case 'p':
+			min_pulse_ns = strtoull(optarg, NULL, 10) * 1000ull;
+			break;
+		case 'g':
+			if (sscanf(optarg, "%u,%u", &long_ms, &double_ms) != 2 ||
+				long_ms == 0) {
+				usage();
+			}
+			long_press_ns = long_ms * 1000000ull;
+			double_press_ns = double_ms * 1000000ull;
+			break;
+		case 'a':
+			if (sscanf(optarg, "%u,%u,%u,%u", &adapt_percentile,
+				&margin_us, &min_us, &max_us) != 4 ||
+				adapt_percentile > 99) {
+				usage();
+			}
+			adapt_margin_ns = margin_us * 1000ull;
+			adapt_min_ns = min_us * 1000ull;
+			adapt_max_ns = max_us * 1000ull;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 1) {
+		usage();
+	}
+	if (window_count == 0) {
+		windows[window_count++] = GC_DEBOUNCE_DEFAULT_MSEC;
+	}
+
+	FILE *f = fopen(argv[optind], "r");
+	if (!f) {
+		perror(argv[optind]);
+		return 1;
+	}
+	int result = format == TEXT ? load_text(f) :
+		format == COMPACT ? load_compact(f, input) : load_full(f, input);
+	fclose(f);
+	if (result) {
+		fprintf(stderr, "gpiocount-replay: out of memory\n");
+		return 1;
+	}
+
+	printf("%10s %10s %10s %10s %10s %10s %10s %7s %12s %12s\n", "window_ms",
+		"final_ms", "presses", "press_rej", "releases", "release_rej",
+		"glitches",
+		"rej_%", "min_gap_us", "max_gap_us");
+	uint64_t start = now_ns();
+	for (int i = 0; i < window_count; i++) {
+		replay(windows[i]);
+	}
+	uint64_t elapsed = now_ns() - start;
+	fprintf(stderr, "%zu edges x %d settings in %.3f ms (%.1f M edges/s)\n",
+		edge_count, window_count, elapsed / 1e6,
+		elapsed ? (double)edge_count * window_count * 1e3 / elapsed : 0.0);
+	free(edges);
+	return 0;
+}